@@ -1,6 +1,6 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
- *           Alpha, and Sparc boxes.
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
+ *           AArch64, Alpha, and Sparc boxes.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
@@ -9,6 +9,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
 #include <sys/times.h>
 #include "clock.h"
 
@@ -16,12 +21,89 @@
 /******************************************************* 
  * Machine dependent functions 
  *
- * Note: the constants __i386__ and  __alpha
+ * Note: the constants __x86_64__, __aarch64__, __i386__ and __alpha
  * are set by GCC when it calls the C preprocessor
  * You can verify this for yourself using gcc -v.
  *******************************************************/
 
-#if defined(__i386__)  
+#if defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+/* Counter value recorded by start_counter */
+static uint64_t cyc_start = 0;
+
+/*
+ * The 64-bit time stamp counter is read with rdtsc, which the CPU is
+ * free to reorder with respect to the code being timed. At the start
+ * of the interval an lfence keeps rdtsc from executing before earlier
+ * instructions have completed. At the end, rdtscp waits for all prior
+ * instructions, and the trailing lfence keeps later ones from starting
+ * before the counter has been read.
+ */
+static inline uint64_t read_counter_start(void)
+{
+    uint32_t hi, lo;
+    asm volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t read_counter_end(void)
+{
+    uint32_t hi, lo, aux;
+    asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi), "=c" (aux) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = read_counter_start();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    /* Unsigned 64-bit subtraction is exact, even across a wraparound */
+    return (double)(read_counter_end() - cyc_start);
+}
+
+#elif defined(__aarch64__)
+/*******************************************************
+ * AArch64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+/* Counter value recorded by start_counter */
+static uint64_t cyc_start = 0;
+
+/*
+ * Read the 64-bit virtual counter. It ticks at the fixed rate given by
+ * cntfrq_el0 rather than at the core clock, but mhz() calibrates
+ * against wall time, so fsecs() still converts to seconds correctly.
+ * The isb keeps the read from being speculated ahead of earlier code.
+ */
+static inline uint64_t read_counter(void)
+{
+    uint64_t val;
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r" (val) : : "memory");
+    return val;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = read_counter();
+}
+
+/* Return the number of counter ticks since the last call to start_counter. */
+double get_counter()
+{
+    /* Unsigned 64-bit subtraction is exact, even across a wraparound */
+    return (double)(read_counter() - cyc_start);
+}
+
+#elif defined(__i386__)  
 /*******************************************************
  * Pentium versions of start_counter() and get_counter()
  *******************************************************/
@@ -195,10 +277,210 @@ double mhz_full(int verbose, int sleeptime)
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/*
+ * counter_mhz - Return the counter rate reported by the hardware, or 0
+ * if the hardware does not report it. On x86-64 this is only trusted
+ * when CPUID says the TSC is invariant and leaf 0x15 gives both the
+ * crystal clock and the TSC/crystal ratio. On AArch64 cntfrq_el0 is
+ * the exact rate of cntvct_el0.
+ */
+static double counter_mhz(void)
+{
+#if defined(__x86_64__)
+    unsigned a, b, c, d;
+
+    asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (0x80000000), "c" (0));
+    if (a < 0x80000007)
+	return 0;
+    asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (0x80000007), "c" (0));
+    if (!(d & (1 << 8)))           /* invariant TSC */
+	return 0;
+    asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (0), "c" (0));
+    if (a < 0x15)
+	return 0;
+    asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (0x15), "c" (0));
+    if (a == 0 || b == 0 || c == 0)
+	return 0;
+    return (double)c * b / a / 1e6;
+#elif defined(__aarch64__)
+    uint64_t freq;
+    asm volatile("mrs %0, cntfrq_el0" : "=r" (freq));
+    return (double)freq / 1e6;
+#else
+    return 0;
+#endif
+}
+
+/* Return the current CLOCK_MONOTONIC_RAW time in seconds */
+static double raw_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define CAL_MSECS    5      /* length of one calibration interval */
+#define CAL_ROUNDS   20     /* give up converging after this many intervals */
+#define CAL_EPSILON  0.001  /* consecutive estimates must agree this closely */
+#define CACHE_DIR    "mdriver" /* under $XDG_CACHE_HOME or ~/.cache */
+
+/*
+ * mhz_monotonic - Estimate the clock rate by counting the cycles that
+ * elapse during short CAL_MSECS intervals of CLOCK_MONOTONIC_RAW. Stops
+ * when two consecutive estimates agree within CAL_EPSILON.
+ */
+static double mhz_monotonic(void)
+{
+    double rate = 0, prev = 0;
+    double t0, t1;
+    int i;
+
+    for (i = 0; i < CAL_ROUNDS; i++) {
+	t0 = raw_secs();
+	start_counter();
+	do {
+	    t1 = raw_secs();
+	} while (t1 - t0 < CAL_MSECS * 1e-3);
+	rate = get_counter() / (1e6 * (t1 - t0));
+	if (prev > 0 && rate < (1 + CAL_EPSILON) * prev &&
+	    prev < (1 + CAL_EPSILON) * rate)
+	    break;
+	prev = rate;
+    }
+    return rate;
+}
+
+/*
+ * The calibrated rate, and the timer interrupt cost measured by
+ * callibrate() below, are cached in a per-host file in the user's own
+ * cache directory ($XDG_CACHE_HOME/mdriver or ~/.cache/mdriver) so that only the first run on a machine pays for the
+ * measurements. The file holds a key naming the boot and the CPU model
+ * the numbers were measured on, so that a reboot or a move to other
+ * hardware under the same host name measures again, then the two
+ * numbers; the second may be 0 if not yet measured.
+ */
+int cache_dir(char *dir, size_t len)
+{
+    const char *base = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    int n, m;
+
+    if (base != NULL && *base != '\0')
+	n = snprintf(dir, len, "%s", base);
+    else if (home != NULL && *home != '\0')
+	n = snprintf(dir, len, "%s/.cache", home);
+    else
+	return 0;
+    if (n < 0 || (size_t)n >= len)
+	return 0;
+    mkdir(dir, 0700);
+    m = snprintf(dir + n, len - n, "/%s", CACHE_DIR);
+    if (m < 0 || (size_t)m >= len - n)
+	return 0;
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+	return 0;
+    return 1;
+}
+
+static int cache_path(char *path, size_t len)
+{
+    char host[256], dir[768];
+    int n;
+
+    if (!cache_dir(dir, sizeof(dir)))
+	return 0;
+    if (gethostname(host, sizeof(host)) < 0)
+	strcpy(host, "localhost");
+    host[sizeof(host) - 1] = '\0';
+    n = snprintf(path, len, "%s/mdriver-clock.%s", dir, host);
+    return n >= 0 && (size_t)n < len;
+}
+
+/* cache_key - The boot ID and a hash of the CPU model, as one word */
+static void cache_key(char *key, size_t len)
+{
+    char boot[64] = "-", line[256];
+    unsigned long h = 2166136261UL;
+    char *p;
+    FILE *fp;
+
+    if ((fp = fopen("/proc/sys/kernel/random/boot_id", "r")) != NULL) {
+	if (fscanf(fp, "%63s", boot) != 1)
+	    strcpy(boot, "-");
+	fclose(fp);
+    }
+    if ((fp = fopen("/proc/cpuinfo", "r")) != NULL) {
+	while (fgets(line, sizeof(line), fp))
+	    if (strncmp(line, "model name", 10) == 0 ||
+		strncmp(line, "CPU part", 8) == 0) {
+		for (p = line; *p; p++)
+		    h = (h ^ (unsigned char)*p) * 16777619UL;
+		break;
+	    }
+	fclose(fp);
+    }
+    snprintf(key, len, "%s/%08lx", boot, h & 0xffffffffUL);
+}
+
+static void read_clock_cache(double *rate, double *cpt)
+{
+    char path[1024], key[128], want[128];
+    FILE *fp;
+
+    *rate = *cpt = 0;
+    if (!cache_path(path, sizeof(path)) || (fp = fopen(path, "r")) == NULL)
+	return;
+    cache_key(want, sizeof(want));
+    if (fscanf(fp, "%127s %lf %lf", key, rate, cpt) != 3 ||
+	strcmp(key, want) != 0 || *rate <= 0)
+	*rate = *cpt = 0;
+    fclose(fp);
+}
+
+/* 
+ * write_clock_cache - Replace the cache with a new file, so a reader
+ *     never sees it half written. A rate that could not be measured is
+ *     not stored.
+ */
+static void write_clock_cache(double rate, double cpt)
+{
+    char path[1024], tmpname[1040], key[128];
+    FILE *fp;
+    int fd;
+
+    if (rate <= 0 || !cache_path(path, sizeof(path)))
+	return;
+    cache_key(key, sizeof(key));
+    snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", path);
+    if ((fd = mkstemp(tmpname)) < 0)
+	return;
+    if ((fp = fdopen(fd, "w")) == NULL) {
+	close(fd);
+	unlink(tmpname);
+	return;
+    }
+    fprintf(fp, "%s %.6f %.6f\n", key, rate, cpt);
+    if (fclose(fp) != 0 || rename(tmpname, path) < 0)
+	unlink(tmpname);
+}
+
+/*
+ * Version that avoids sleeping: use the cached rate for this host if
+ * there is one, otherwise the rate the hardware reports, otherwise a
+ * few milliseconds of measurement against CLOCK_MONOTONIC_RAW.
+ */
 double mhz(int verbose)
 {
-    return mhz_full(verbose, 2);
+    double rate, cpt;
+
+    read_clock_cache(&rate, &cpt);
+    if (rate <= 0) {
+	if ((rate = counter_mhz()) <= 0)
+	    rate = mhz_monotonic();
+	write_clock_cache(rate, cpt);
+    }
+    if (verbose)
+	printf("Processor clock rate ~= %.1f MHz\n", rate);
+    return rate;
 }
 
 /** Special counters that compensate for timer interrupt overhead */
@@ -216,6 +498,14 @@ static void callibrate(int verbose)
     struct tms t;
     clock_t oldc;
     int e = 0;
+    double rate;
+
+    read_clock_cache(&rate, &cyc_per_tick);
+    if (cyc_per_tick > 0) {
+	if (verbose)
+	    printf("Using cached cyc_per_tick %f\n", cyc_per_tick);
+	return;
+    }
 
     times(&t);
     oldc = t.tms_utime;
@@ -243,6 +533,7 @@ static void callibrate(int verbose)
 	    oldt = newt;
 	}
     }
+    write_clock_cache(rate, cyc_per_tick);
     if (verbose)
 	printf("Setting cyc_per_tick to %f\n", cyc_per_tick);
 }
@@ -1,4 +1,5 @@
 /* Routines for using cycle counter */
+#include <stddef.h>
 
 /* Start the counter */
 void start_counter();
@@ -9,7 +10,14 @@ double get_counter();
 /* Measure overhead for counter */
 double ovhd();
 
-/* Determine clock rate of processor (using a default sleeptime) */
+/* 
+ * Put the user's own directory for mdriver's cache files in dir, which
+ * has room for len bytes, creating it if need be. Returns 0 if there
+ * is none, or if its name doesn't fit.
+ */
+int cache_dir(char *dir, size_t len);
+
+/* Determine clock rate of processor (cached per host, no sleeping) */
 double mhz(int verbose);
 
 /* Determine clock rate of processor, having more control over accuracy */
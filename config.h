@@ -36,14 +36,13 @@
 
 
 /*
- * This constant gives the estimated performance of the libc malloc
- * package using our traces on mirage. Its purpose is to cap the
+ * The throughput of the libc malloc package on the traces caps the
  * contribution of throughput to the performance index. Once you
- * surpass the AVG_LIBC_THRUPUT, you get no further benefit to your
- * score. This should discourage you from building extremely fast,
- * but extremely simple malloc packages.
+ * surpass libc, you get no further benefit to your score. This should
+ * discourage you from building extremely fast, but extremely simple
+ * malloc packages. mdriver measures libc on the current host and
+ * caches the result in $TMPDIR/mdriver-libc.<hostname> (see -R).
  */
-#define AVG_LIBC_THRUPUT      6000E3  /* 6000 Kops/sec */
 
  /* 
   * This constant determines the contributions of space utilization
@@ -62,11 +61,22 @@
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/*
+ * HAVE_CYCLE_COUNTER is set on the platforms for which clock.c
+ * implements start_counter() and get_counter().
+ */
+#if defined(__x86_64__) || defined(__aarch64__) || \
+    defined(__i386__) || defined(__alpha)
+#define HAVE_CYCLE_COUNTER 1
+#else
+#define HAVE_CYCLE_COUNTER 0
+#endif
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
-#define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_FCYC   HAVE_CYCLE_COUNTER    /* cycle counter w/K-best scheme */
+#define USE_ITIMER 0                     /* interval timer (any Unix box) */
+#define USE_GETTOD (!HAVE_CYCLE_COUNTER) /* gettimeofday (any Unix box) */
 
 #endif /* __CONFIG_H */
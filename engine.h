@@ -0,0 +1,32 @@
+/*
+ * engine.h - Allocator engines: malloc packages in shared libraries
+ *     that mdriver -E loads and evaluates side by side in one run
+ *
+ * An engine library exports one mm_engine_t, named by ENGINE_SYMBOL.
+ * Each engine has a heap of its own, so engines never see each other's
+ * blocks. mmengine.c turns an mm.c variant into an engine.
+ */
+#include <stddef.h>
+
+#define ENGINE_VERSION  1            /* bumped when mm_engine_t changes */
+#define ENGINE_SYMBOL   "mm_engine"  /* what mdriver looks up with dlsym */
+
+typedef struct {
+    int version;                     /* ENGINE_VERSION */
+    const char *name;                /* column heading in mdriver's table */
+
+    /* Start over with an empty heap. Returns -1 on failure. */
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+
+    /* 
+     * Optional, NULL if the engine can't tell: the bytes of heap in
+     * use, for utilization, and the heap's first and last bytes, to
+     * check that payloads lie inside it
+     */
+    size_t (*heapsize)(void);
+    void *(*heap_lo)(void);
+    void *(*heap_hi)(void);
+} mm_engine_t;
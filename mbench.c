@@ -0,0 +1,524 @@
+/*
+ * mbench.c - Microbenchmarks of canonical allocation patterns
+ *
+ * Unlike mdriver, which replays the .rep traces, each kernel here
+ * exercises a single allocation pattern, so that a regression can be
+ * pinned on one code path in mm.c. Every kernel is run against both
+ * the mm.c package and libc malloc and reports:
+ *
+ *     ns/op      average time per malloc/free/realloc call
+ *     heap/live  heap footprint when the most payload bytes were live,
+ *                divided by that number of live payload bytes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/wait.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+#include "config.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define DEF_NOPS   100000    /* default number of iterations per kernel */
+#define DEF_SIZE   64        /* default request size in bytes */
+#define DEF_DEPTH  1000      /* default number of live blocks */
+#define DEF_LARGE  (1<<18)   /* request size for the large-block kernel */
+#define DEF_LARGE_DEPTH 8    /* live blocks for the large-block kernel */
+#define REALLOC_STEPS 64     /* length of each growing realloc chain */
+
+/* glibc 2.33 added mallinfo2, which reports sizes without overflow */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#define HAVE_MALLINFO2 1
+#else
+#define HAVE_MALLINFO2 0
+#endif
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* An allocator under test */
+typedef struct {
+    char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    size_t (*footprint)(void);
+    int isolate;         /* run each kernel in a child process */
+} allocator_t;
+
+/* Parameters and results of one kernel run, passed through fsecs */
+typedef struct {
+    allocator_t *alloc;
+    int nops;            /* iterations */
+    int size;            /* request size (max size for random kernel) */
+    int depth;           /* number of live blocks */
+    void **slots;        /* live blocks... */
+    size_t *slot_sizes;  /* ... and their payload sizes */
+
+    int account;         /* if set, track live bytes and footprint */
+    int failed;          /* set if the allocator returned NULL */
+    double ops;          /* number of allocator calls made */
+    size_t live;         /* current live payload bytes */
+    size_t peak_live;    /* high water mark of live payload bytes */
+    size_t peak_heap;    /* footprint sampled at the high water mark */
+} bench_t;
+
+/* A benchmark kernel */
+typedef struct {
+    char *name;
+    void (*run)(void *ptr);
+    int large;           /* use the large-block size and depth */
+} kernel_t;
+
+/********************
+ * Global variables
+ *******************/
+int verbose = 0;         /* global flag for verbose output (used by fsecs) */
+static unsigned rng = 1; /* state of the kernels' random number generator */
+
+/*********************
+ * Function prototypes
+ *********************/
+
+/* Allocator adapters */
+static int mm_init_wrap(void);
+static size_t mm_footprint(void);
+static int libc_init(void);
+static size_t libc_footprint(void);
+
+/* Kernels */
+static void k_pingpong(void *ptr);
+static void k_lifo(void *ptr);
+static void k_fifo(void *ptr);
+static void k_random(void *ptr);
+static void k_realloc(void *ptr);
+static void k_large(void *ptr);
+
+/* Helpers */
+static void run_kernel(kernel_t *k, allocator_t *a, int nops, int size,
+                       int depth);
+static void usage(void);
+static void unix_error(char *msg);
+
+static allocator_t allocators[] = {
+    {"mm", mm_init_wrap, mm_malloc, mm_free, mm_realloc, mm_footprint, 0},
+    {"libc", libc_init, malloc, free, realloc, libc_footprint, 1},
+};
+
+static kernel_t kernels[] = {
+    {"pingpong", k_pingpong, 0},
+    {"lifo",     k_lifo,     0},
+    {"fifo",     k_fifo,     0},
+    {"random",   k_random,   0},
+    {"realloc",  k_realloc,  0},
+    {"large",    k_large,    1},
+};
+
+#define NALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+#define NKERNELS    (sizeof(kernels) / sizeof(kernels[0]))
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c;
+    unsigned i, j;
+    char *only = NULL;   /* run only this kernel (-k) */
+    int nops = DEF_NOPS;
+    int size = 0;
+    int depth = 0;
+
+    while ((c = getopt(argc, argv, "k:n:s:d:hv")) != EOF) {
+        switch (c) {
+        case 'k': /* Run a single kernel */
+            only = optarg;
+            break;
+        case 'n': /* Iterations per kernel */
+            nops = atoi(optarg);
+            break;
+        case 's': /* Request size */
+            size = atoi(optarg);
+            break;
+        case 'd': /* Live blocks */
+            depth = atoi(optarg);
+            break;
+        case 'v': /* Print timer information */
+            verbose = 1;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (nops <= 0 || size < 0 || depth < 0) {
+        usage();
+        exit(1);
+    }
+
+    init_fsecs();
+    mem_init();
+
+    printf("%-10s%-6s%10s%11s\n", "kernel", "alloc", "ns/op", "heap/live");
+    for (i = 0; i < NKERNELS; i++) {
+        if (only && strcmp(only, kernels[i].name))
+            continue;
+        for (j = 0; j < NALLOCATORS; j++)
+            run_kernel(&kernels[i], &allocators[j], nops,
+                       size ? size : (kernels[i].large ? DEF_LARGE : DEF_SIZE),
+                       depth ? depth : (kernels[i].large ? DEF_LARGE_DEPTH
+                                        : DEF_DEPTH));
+    }
+
+    mem_deinit();
+    exit(0);
+}
+
+/*
+ * run_kernel - Run kernel k once untimed to check that it completes and
+ *     to measure its footprint, then time it with fsecs and print a row.
+ *     An isolated allocator runs it in a child process, so that the free
+ *     memory one kernel leaves in libc's arena is neither reused by the
+ *     next nor counted in its footprint.
+ */
+static void run_kernel(kernel_t *k, allocator_t *a, int nops, int size,
+                       int depth)
+{
+    bench_t b;
+    double secs;
+    pid_t pid = 0;
+    int status;
+
+    if (a->isolate) {
+        fflush(stdout);
+        if ((pid = fork()) < 0)
+            unix_error("fork failed in run_kernel");
+        if (pid > 0) {
+            if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+                WEXITSTATUS(status) != 0)
+                printf("%-10s%-6s%10s%11s\n", k->name, a->name, "failed", 
+                       "-");
+            return;
+        }
+    }
+
+    memset(&b, 0, sizeof(b));
+    b.alloc = a;
+    b.nops = nops;
+    b.size = size;
+    b.depth = depth;
+    if ((b.slots = calloc(depth, sizeof(void *))) == NULL ||
+        (b.slot_sizes = calloc(depth, sizeof(size_t))) == NULL)
+        unix_error("calloc failed in run_kernel");
+
+    b.account = 1;
+    k->run(&b);
+    if (b.failed) {
+        printf("%-10s%-6s%10s%11s\n", k->name, a->name, "failed", "-");
+    }
+    else {
+        b.account = 0;
+        secs = fsecs(k->run, &b);
+        if (b.peak_heap == 0)   /* served from memory it already held */
+            printf("%-10s%-6s%10.1f%11s\n", k->name, a->name,
+                   secs * 1e9 / b.ops, "-");
+        else
+            printf("%-10s%-6s%10.1f%11.2f\n", k->name, a->name,
+                   secs * 1e9 / b.ops,
+                   b.peak_live ? (double)b.peak_heap / b.peak_live : 0.0);
+    }
+
+    free(b.slots);
+    free(b.slot_sizes);
+    if (a->isolate) {
+        fflush(stdout);
+        _exit(0);
+    }
+}
+
+/*************************************************************
+ * Allocation wrappers used by the kernels. When b->account is
+ * set they also maintain the live byte count and sample the
+ * allocator's footprint at each new high water mark.
+ *************************************************************/
+
+static inline void *bench_malloc(bench_t *b, size_t size)
+{
+    void *p = b->alloc->malloc(size);
+
+    if (p == NULL)
+        b->failed = 1;
+    else if (b->account) {
+        b->ops++;
+        b->live += size;
+        if (b->live > b->peak_live) {
+            b->peak_live = b->live;
+            b->peak_heap = b->alloc->footprint();
+        }
+    }
+    return p;
+}
+
+static inline void bench_free(bench_t *b, void *p, size_t size)
+{
+    b->alloc->free(p);
+    if (b->account) {
+        b->ops++;
+        b->live -= size;
+    }
+}
+
+static inline void *bench_realloc(bench_t *b, void *p, size_t oldsize,
+                                  size_t size)
+{
+    void *newp = b->alloc->realloc(p, size);
+
+    if (newp == NULL)
+        b->failed = 1;
+    else if (b->account) {
+        b->ops++;
+        b->live += size - oldsize;
+        if (b->live > b->peak_live) {
+            b->peak_live = b->live;
+            b->peak_heap = b->alloc->footprint();
+        }
+    }
+    return newp;
+}
+
+/* Cheap deterministic random numbers, so every allocator sees the same ops */
+static inline unsigned next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/********************************************************
+ * The kernels. Each is an fsecs test function taking a
+ * bench_t, and leaves no blocks allocated when it returns.
+ ********************************************************/
+
+/*
+ * k_pingpong - malloc and immediately free a block of the same size
+ */
+static void k_pingpong(void *ptr)
+{
+    bench_t *b = ptr;
+    int i;
+    void *p;
+
+    if (b->alloc->init() < 0)
+        unix_error("allocator init failed");
+    for (i = 0; i < b->nops && !b->failed; i++) {
+        if ((p = bench_malloc(b, b->size)) != NULL)
+            bench_free(b, p, b->size);
+    }
+}
+
+/*
+ * k_lifo - allocate depth blocks, then free them in reverse order
+ */
+static void k_lifo(void *ptr)
+{
+    bench_t *b = ptr;
+    int i, j;
+
+    if (b->alloc->init() < 0)
+        unix_error("allocator init failed");
+    for (i = 0; i < b->nops && !b->failed; i += b->depth) {
+        for (j = 0; j < b->depth; j++)
+            if ((b->slots[j] = bench_malloc(b, b->size)) == NULL)
+                break;
+        while (--j >= 0)
+            bench_free(b, b->slots[j], b->size);
+    }
+}
+
+/*
+ * k_fifo - keep depth blocks live, always freeing the oldest one
+ */
+static void k_fifo(void *ptr)
+{
+    bench_t *b = ptr;
+    int i, j;
+
+    if (b->alloc->init() < 0)
+        unix_error("allocator init failed");
+    for (j = 0; j < b->depth; j++)
+        if ((b->slots[j] = bench_malloc(b, b->size)) == NULL)
+            break;
+    for (i = 0; i < b->nops && !b->failed; i++) {
+        j = i % b->depth;
+        bench_free(b, b->slots[j], b->size);
+        if ((b->slots[j] = bench_malloc(b, b->size)) == NULL)
+            break;
+    }
+    for (j = 0; j < b->depth; j++)
+        if (b->slots[j] != NULL) {
+            bench_free(b, b->slots[j], b->size);
+            b->slots[j] = NULL;
+        }
+}
+
+/*
+ * k_random - a pool of depth slots; each step picks a random slot and
+ *     frees its block if it holds one, or allocates a block with a
+ *     random size in [1, size] if it is empty
+ */
+static void k_random(void *ptr)
+{
+    bench_t *b = ptr;
+    int i, j;
+
+    if (b->alloc->init() < 0)
+        unix_error("allocator init failed");
+    rng = 1;
+    for (i = 0; i < b->nops && !b->failed; i++) {
+        j = next_rand() % b->depth;
+        if (b->slots[j] != NULL) {
+            bench_free(b, b->slots[j], b->slot_sizes[j]);
+            b->slots[j] = NULL;
+        }
+        else {
+            b->slot_sizes[j] = 1 + next_rand() % b->size;
+            b->slots[j] = bench_malloc(b, b->slot_sizes[j]);
+        }
+    }
+    for (j = 0; j < b->depth; j++)
+        if (b->slots[j] != NULL) {
+            bench_free(b, b->slots[j], b->slot_sizes[j]);
+            b->slots[j] = NULL;
+        }
+}
+
+/*
+ * k_realloc - grow a block by size bytes at a time with realloc, for
+ *     chains of REALLOC_STEPS steps
+ */
+static void k_realloc(void *ptr)
+{
+    bench_t *b = ptr;
+    int i, j;
+    void *p, *newp;
+
+    if (b->alloc->init() < 0)
+        unix_error("allocator init failed");
+    for (i = 0; i < b->nops && !b->failed; i += REALLOC_STEPS) {
+        if ((p = bench_malloc(b, b->size)) == NULL)
+            break;
+        for (j = 1; j < REALLOC_STEPS; j++) {
+            newp = bench_realloc(b, p, (size_t)j * b->size,
+                                 (size_t)(j + 1) * b->size);
+            if (newp == NULL)
+                break;
+            p = newp;
+        }
+        bench_free(b, p, (size_t)j * b->size);
+    }
+}
+
+/*
+ * k_large - the fifo pattern with large blocks
+ */
+static void k_large(void *ptr)
+{
+    k_fifo(ptr);
+}
+
+/******************************************
+ * Adapters for the allocators under test
+ *****************************************/
+
+/* Start mm.c on an empty simulated heap */
+static int mm_init_wrap(void)
+{
+    mem_reset_brk();
+    return mm_init();
+}
+
+/* The simulated brk never moves down, so the heap size is its footprint */
+static size_t mm_footprint(void)
+{
+    return mem_heapsize();
+}
+
+/* Bytes libc held from the system when a kernel started */
+static size_t libc_base = 0;
+
+/* 
+ * Give back the free memory left over from earlier kernels first, so
+ * that a kernel neither inherits it nor gets it counted against it
+ */
+static int libc_init(void)
+{
+#if HAVE_MALLINFO2
+    struct mallinfo2 mi;
+
+    malloc_trim(0);
+    mi = mallinfo2();
+    libc_base = mi.arena + mi.hblkhd;
+#endif
+    return 0;
+}
+
+/*
+ * Bytes libc has obtained from the system, in its arena and in mmaps,
+ * beyond what it held when the kernel started
+ */
+static size_t libc_footprint(void)
+{
+#if HAVE_MALLINFO2
+    struct mallinfo2 mi = mallinfo2();
+    size_t held = mi.arena + mi.hblkhd;
+
+    return held > libc_base ? held - libc_base : 0;
+#else
+    return 0;
+#endif
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mbench [-hv] [-k <kernel>] [-n <ops>] [-s <size>] [-d <depth>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-d <depth>  Number of live blocks.\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-k <kernel> Run only <kernel> (pingpong, lifo, fifo,\n"
+                    "\t            random, realloc, large).\n");
+    fprintf(stderr, "\t-n <ops>    Iterations per kernel.\n");
+    fprintf(stderr, "\t-s <size>   Request size in bytes.\n");
+    fprintf(stderr, "\t-v          Print timer information.\n");
+}
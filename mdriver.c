@@ -15,10 +15,25 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <math.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
+#include "prof.h"
+#include "trace.h"
+#include "oracle.h"
+#include "engine.h"
 #include "config.h"
 
 /**********************
@@ -29,6 +44,36 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MAXREPS      100 /* max timing repetitions per trace (-r) */
+#define MAXMETRICS    16 /* max extra metrics recorded per trace */
+
+/* Comparator (-b/-B) settings */
+#define COMPARE_REPS    10    /* default repetitions when comparing */
+#define SIG_LEVEL       0.05  /* significance level for throughput changes */
+#define UTIL_TOLERANCE  0.001 /* utilization drop that counts as a regression */
+
+/* Host throughput ceiling for the performance index */
+#define THRUPUT_CACHE    "mdriver-libc" /* per-host cache file name prefix */
+
+/* System allocators (-l, -L) */
+#define MAXSYSALLOCS     8    /* libc plus up to 7 loaded with -L */
+
+/* Allocator engines (-E) */
+#define MAXENGINES       8    /* mm plus up to 7 loaded with -E */
+
+/* glibc 2.33 added mallinfo2, which reports sizes without overflow */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#define HAVE_MALLINFO2 1
+#else
+#define HAVE_MALLINFO2 0
+#endif
+
+/* Fragmentation report (-F) settings */
+#define NFRAGCLASSES    12    /* request size classes: 1-16, 17-32, ..., 16K+ */
+
+/* Profiling (-p) settings */
+#define PROF_SECS       1.0   /* CPU seconds to profile each trace */
+#define PROF_TOP        12    /* functions listed per trace */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
@@ -37,30 +82,40 @@
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, in a treap ordered by lo */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges below this one... */
+    struct range_t *right; /* ...and above it */
+    unsigned prio;         /* treap priority, a heap order on the tree */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/* Bytes of allocated blocks at peak, by source, for one request size class */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
+    int blocks;         /* allocated blocks */
+    double payload;     /* requested bytes */
+    double rounding;    /* alignment and minimum size padding of the request */
+    double overhead;    /* header and footer */
+    double slack;       /* remainder that place() left unsplit */
+} frag_t;
+
+/* A system malloc package evaluated alongside mm.c: libc or one from -L */
 typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
+    char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    int is_libc;     /* footprint can also be read from mallinfo2 */
+} sysalloc_t;
+
+/* A mid-trace state of mm that timing runs start from (-s) */
+typedef struct {
+    int op;              /* first request after the checkpoint */
+    mem_snapshot_t heap; /* memlib's heap... */
+    void *mm_state;      /* ...mm's state outside it... */
+    char **blocks;       /* ...and the payload of each block id */
+} checkpoint_t;
 
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
@@ -70,17 +125,42 @@ typedef struct {
 typedef struct {
     trace_t *trace;  
     range_t *ranges;
+    sysalloc_t *alloc;   /* system allocator for eval_libc_speed */
+    mm_engine_t *engine; /* allocator engine for eval_engine_speed */
+    checkpoint_t *ckpt;  /* where eval_mm_resume starts */
 } speed_t;
 
+/* A setting of mm's tunable parameters, and how mm did with it */
+typedef struct {
+    size_t param[MM_NPARAMS];
+    int valid;       /* mm accepted the setting and ran every trace */
+    double util;     /* weighted over the traces */
+    double kops;
+} tunepoint_t;
+
+/* A named measurement reported alongside the standard stats */
+typedef struct {
+    char *name;
+    double value;
+} metric_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
+    int weight;      /* weight of the trace in the performance index */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    int nsamples;    /* number of timing repetitions... */
+    double samples[MAXREPS]; /* ...and the secs measured by each one */
 
     /* defined only for the student malloc package */
-    double util;     /* space utilization for this trace (always 0 for libc) */
+    double util;     /* space utilization for this trace (for system
+                        allocators, estimated from their footprint) */
+
+    /* additional measurements, written to the JSON and CSV output */
+    int nmetrics;
+    metric_t metrics[MAXMETRICS];
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -90,7 +170,8 @@ typedef struct {
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
-char msg[MAXLINE];      /* for whenever we need to compose an error message */
+static int presize = 0; /* start mm's heap at the trace's suggested size (-H) */
+char msg[2*MAXLINE];    /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -100,6 +181,29 @@ static char *default_tracefiles[] = {
                                      DEFAULT_TRACEFILES, NULL
 };
 
+/* The libc malloc package, as run by -l and by libc_thruput */
+static sysalloc_t libc_alloc = {"libc", malloc, free, realloc, 1};
+
+/* The linked-in mm.c as an engine, the first column of -E's table */
+static int mm_engine_init(void)
+{
+    mem_reset_brk();
+    return mm_init();
+}
+static mm_engine_t mm_builtin = {
+    ENGINE_VERSION, "mm", mm_engine_init, mm_malloc, mm_free, mm_realloc,
+    mem_heapsize, mem_heap_lo, mem_heap_hi
+};
+
+/* System allocators that -L all tries to load */
+static char *known_allocators[] = {
+    "libjemalloc.so.2",
+    "libtcmalloc_minimal.so.4",
+    "libtcmalloc.so.4",
+    "libmimalloc.so.2",
+    NULL
+};
+
 
 /********************* 
  * Function prototypes 
@@ -107,26 +211,79 @@ static char *default_tracefiles[] = {
 
 /* these functions manipulate range lists */
 static int add_range(range_t **ranges, char *lo, int size, 
-                     int tracenum, int opnum);
+                     int tracenum, int opnum, char *heap_lo, char *heap_hi);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
 
-/* Routines for evaluating the correctness and speed of libc malloc */
-static int eval_libc_valid(trace_t *trace, int tracenum);
+/* Routines for evaluating the correctness, footprint, and speed of 
+   libc malloc and the other system allocators */
+static int load_sysalloc(sysalloc_t *alloc, char *lib);
+static int eval_libc_valid(trace_t *trace, int tracenum, sysalloc_t *alloc);
+static void eval_libc_footprint(trace_t *trace, sysalloc_t *alloc,
+                                stats_t *stats);
 static void eval_libc_speed(void *ptr);
 
+/* Routines for evaluating the allocator engines loaded with -E */
+static mm_engine_t *load_engine(char *lib);
+static int eval_engine_valid(trace_t *trace, int tracenum, 
+                             mm_engine_t *engine, range_t **ranges);
+static double eval_engine_util(trace_t *trace, mm_engine_t *engine);
+static void eval_engine_speed(void *ptr);
+
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
+static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges,
+                         double *util);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void replay_mm(trace_t *trace, int start, int end);
+static void take_checkpoint(trace_t *trace, int op, char *path,
+                            checkpoint_t *ckpt);
+static void restore_checkpoint(trace_t *trace, checkpoint_t *ckpt);
+static void free_checkpoint(checkpoint_t *ckpt);
+static void eval_mm_restore(void *ptr);
+static void eval_mm_resume(void *ptr);
+static void eval_mm_frag(trace_t *trace, int tracenum, stats_t *stats);
+static int init_mm(trace_t *trace);
+
+/* These functions write, read, and compare machine-readable results */
+static void add_sample(stats_t *stats, double secs);
+static void add_metric(stats_t *stats, char *name, double value);
+static void write_json(char *path, char **tracefiles, int n, int nsys,
+                       sysalloc_t *sysallocs, stats_t **sys_stats, 
+                       stats_t *mm_stats);
+static void write_csv(char *path, char **tracefiles, int n, int nsys,
+                      sysalloc_t *sysallocs, stats_t **sys_stats, 
+                      stats_t *mm_stats);
+static void read_baseline(char *path, char **tracefiles, int n,
+                          stats_t *base_stats);
+static void run_baseline(char *prog, char *tracedir, char *tracefile,
+                         stats_t *base_stats);
+static int compare_results(int n, stats_t *base_stats, stats_t *mm_stats);
+static char *basename_of(char *path);
 
 /* Various helper routines */
+static void dump_events(char *dir, char *tracefile);
 static void printresults(int n, stats_t *stats);
+static double weighted_util(int n, stats_t *stats);
+static double weighted_thruput(int n, stats_t *stats);
+static double libc_thruput(char **tracefiles, int n, stats_t *libc_stats,
+                           int remeasure);
+static void printutil(int n, stats_t *mm_stats, int nsys, 
+                      sysalloc_t *sysallocs, stats_t **sys_stats);
+static void printoracle(int n, stats_t *mm_stats);
+static void autotune(char **tracefiles, int n, int reps);
+static void run_engines(char **tracefiles, int n, int reps,
+                        mm_engine_t **engines, int nengines);
+static void run_tenants(char **tracefiles, int n, int reps, int mix,
+                        double *weights);
+static int replay_checked(trace_t *trace, int tracenum, range_t **ranges,
+                          int start, int end);
+static int restart_trace(trace_t *trace, int tracenum, char *name,
+                         char *path);
+static void run_restarts(char **tracefiles, int n, char *path);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -137,42 +294,79 @@ static void app_error(char *msg);
  **************/
 int main(int argc, char **argv)
 {
-    int i;
+    int i, j;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
-    stats_t *libc_stats = NULL;/* libc stats for each trace */
+    sysalloc_t sysallocs[MAXSYSALLOCS]; /* libc and -L allocators... */
+    stats_t *sys_stats[MAXSYSALLOCS];   /* ...and their stats per trace */
+    int nsys = 0;
+    char *sys_libs[MAXSYSALLOCS];       /* libraries named by -L */
+    int nlibs = 0;
+    mm_engine_t *engines[MAXENGINES];   /* mm and the -E engines */
+    int nengines = 1;
+    char *err;
+    int mix = -1;               /* replay the traces as tenants (-M) */
+    double *mix_weights = NULL; /* ...with these weights */
+    int num_weights = 0;
+    int a;
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    stats_t *base_stats = NULL;/* baseline stats to compare against (-b/-B) */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int reps = 0;        /* timing repetitions per trace (-r) */
+    int r, regressions = 0;
+    char *json_file = NULL;     /* write results as JSON here (-j) */
+    char *csv_file = NULL;      /* write results as CSV here (-c) */
+    char *baseline_file = NULL; /* saved JSON results to compare with (-b) */
+    char *baseline_prog = NULL; /* baseline mdriver to run interleaved (-B) */
+    FILE *prof_fp = NULL;       /* folded stacks from profiling (-p) */
+    char *event_dir = NULL;     /* dump mm event rings here (-e) */
+    int frag_report = 0;        /* report fragmentation at peak (-F) */
+    int remeasure = 0;          /* remeasure the libc ceiling (-R) */
+    int run_oracle = 0;         /* compare util with the oracle's (-O) */
+    int tune = 0;               /* search mm's parameters (-T) */
+    int fused = 0;              /* take util from the correctness pass (-U) */
+    double fused_util;          /* ...which measures it too */
+    char *ckpt_arg = NULL;      /* start timing runs at this request (-s) */
+    long ckpt_n = 0;            /* ...which is this one */
+    int ckpt_pct = 0;           /* ...or this percent of the way through */
+    char *ckpt_file = NULL;     /* ...keeping the checkpoint here (-K) */
+    char *persist_file = NULL;  /* test restarts with the heap here (-P) */
+    checkpoint_t ckpt;
+    double secs;
+    double oracle_heap;         /* heap the offline placement needs */
+    char *end;
+    double ceiling;             /* libc throughput on this host */
 
     /* temporaries used to compute the performance index */
-    double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    double avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
     int numcorrect;
     
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVgalL:E:M:j:c:b:B:r:p:e:s:K:P:FRHOTU")) != EOF) {
         switch (c) {
         case 'g': /* Generate summary info for the autograder */
             autograder = 1;
             break;
-        case 'f': /* Use one specific trace file only (relative to curr dir) */
-            num_tracefiles = 1;
-            if ((tracefiles = realloc(tracefiles, 2*sizeof(char *))) == NULL)
+        case 'f': /* Use specific trace files only (relative to curr dir) */
+            if ((tracefiles = realloc(tracefiles, 
+                                      (num_tracefiles + 2)*sizeof(char *))) 
+                == NULL)
                 unix_error("ERROR: realloc failed in main");
-            strcpy(tracedir, "./"); 
-            tracefiles[0] = strdup(optarg);
-            tracefiles[1] = NULL;
+            strcpy(tracedir, ""); 
+            tracefiles[num_tracefiles++] = strdup(optarg);
+            tracefiles[num_tracefiles] = NULL;
             break;
         case 't': /* Directory where the traces are located */
-            if (num_tracefiles == 1) /* ignore if -f already encountered */
+            if (num_tracefiles > 0) /* ignore if -f already encountered */
                 break;
             strcpy(tracedir, optarg);
             if (tracedir[strlen(tracedir)-1] != '/') 
@@ -184,6 +378,112 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'L': /* Run another system allocator, or "all" known ones */
+            if (nlibs < MAXSYSALLOCS - 1)
+                sys_libs[nlibs++] = optarg;
+            break;
+        case 'E': /* Compare with the allocator engine in a library */
+            if (nengines == MAXENGINES) {
+                sprintf(msg, "At most %d engines can be loaded with -E",
+                        MAXENGINES - 1);
+                app_error(msg);
+            }
+            if ((engines[nengines++] = load_engine(optarg)) == NULL) {
+                err = dlerror();
+                sprintf(msg, "Could not load engine %s: %s", optarg, 
+                        err ? err : "not an engine (see engine.h)");
+                app_error(msg);
+            }
+            break;
+        case 'M': /* Replay the traces interleaved, as tenants of one heap */
+            err = strchr(optarg, ':');
+            if (err)
+                *err++ = '\0';
+            if (!strcmp(optarg, "rr"))
+                mix = MIX_RR;
+            else if (!strcmp(optarg, "weighted"))
+                mix = MIX_WEIGHTED;
+            else if (!strcmp(optarg, "arrival"))
+                mix = MIX_ARRIVAL;
+            else {
+                usage();
+                exit(1);
+            }
+            while (err && *err) {
+                mix_weights = realloc(mix_weights, 
+                                      (num_weights + 1) * sizeof(double));
+                if (mix_weights == NULL)
+                    unix_error("ERROR: realloc failed in main");
+                mix_weights[num_weights] = strtod(err, &err);
+                if (mix_weights[num_weights++] <= 0 || 
+                    (*err && *err++ != ',')) {
+                    usage();
+                    exit(1);
+                }
+            }
+            break;
+        case 'j': /* Write results as JSON */
+            json_file = optarg;
+            break;
+        case 'c': /* Write results as CSV */
+            csv_file = optarg;
+            break;
+        case 'b': /* Compare against saved JSON results */
+            baseline_file = optarg;
+            break;
+        case 'B': /* Compare against another mdriver, run interleaved */
+            baseline_prog = optarg;
+            break;
+        case 'H': /* Pre-size mm's heap from the trace headers */
+            presize = 1;
+            break;
+        case 's': /* Time each trace from a checkpoint at a request */
+            ckpt_arg = optarg;
+            ckpt_n = strtol(optarg, &end, 10);
+            ckpt_pct = (*end == '%');
+            if (end == optarg || end[ckpt_pct] != '\0' || ckpt_n < 0 ||
+                (ckpt_pct && ckpt_n >= 100)) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'K': /* Keep the checkpoint's heap in a file */
+            ckpt_file = optarg;
+            break;
+        case 'P': /* Test restarting mm on a heap kept in a file */
+            persist_file = optarg;
+            break;
+        case 'U': /* Skip the separate utilization pass */
+            fused = 1;
+            break;
+        case 'T': /* Search mm's tunable parameters */
+            tune = 1;
+            break;
+        case 'O': /* Compare util with an offline placement of the trace */
+            run_oracle = 1;
+            break;
+        case 'R': /* Remeasure the libc throughput ceiling for this host */
+            remeasure = 1;
+            break;
+        case 'F': /* Break down the heap at peak by source of waste */
+            frag_report = 1;
+            break;
+        case 'e': /* Dump mm's event ring for each trace */
+            event_dir = optarg;
+            break;
+        case 'p': /* Profile mm malloc, writing folded stacks to a file */
+            if ((prof_fp = fopen(optarg, "w")) == NULL) {
+                sprintf(msg, "Could not open %s for -p", optarg);
+                unix_error(msg);
+            }
+            break;
+        case 'r': /* Timing repetitions per trace */
+            reps = atoi(optarg);
+            if (reps < 1 || reps > MAXREPS) {
+                usage();
+                exit(1);
+            }
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -235,41 +535,124 @@ int main(int argc, char **argv)
         printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    /* Load the baseline results before doing any work */
+    if (baseline_file || baseline_prog) {
+        if (reps == 0)
+            reps = COMPARE_REPS;
+        base_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+        if (base_stats == NULL)
+            unix_error("base_stats calloc in main failed");
+        if (!baseline_prog)
+            read_baseline(baseline_file, tracefiles, num_tracefiles, 
+                          base_stats);
+    }
+    if (reps == 0)
+        reps = 1;
+
     /* Initialize the timing package */
     init_fsecs();
 
+    /* Search mm's parameters instead of evaluating the allocators */
+    if (tune) {
+        mem_init();
+        autotune(tracefiles, num_tracefiles, reps);
+        exit(errors ? 1 : 0);
+    }
+
+    /* Test restarts on a persistent heap instead */
+    if (persist_file) {
+        run_restarts(tracefiles, num_tracefiles, persist_file);
+        exit(errors ? 1 : 0);
+    }
+
+    /* Replay the traces as tenants of one heap instead */
+    if (mix >= 0) {
+        if (num_weights && num_weights != num_tracefiles) {
+            printf("ERROR: -M has %d weights for %d traces\n", 
+                   num_weights, num_tracefiles);
+            exit(1);
+        }
+        mem_init();
+        run_tenants(tracefiles, num_tracefiles, reps, mix, mix_weights);
+        exit(errors ? 1 : 0);
+    }
+
+    /* Compare mm with the engines instead */
+    if (nengines > 1) {
+        mem_init();
+        engines[0] = &mm_builtin;
+        run_engines(tracefiles, num_tracefiles, reps, engines, nengines);
+        exit(errors ? 1 : 0);
+    }
+
+    /* Collect the system allocators to evaluate: libc, then any -L */
+    if (run_libc)
+        sysallocs[nsys++] = libc_alloc;
+    for (i = 0; i < nlibs; i++) {
+        if (strcmp(sys_libs[i], "all")) {
+            if (!load_sysalloc(&sysallocs[nsys], sys_libs[i])) {
+                sprintf(msg, "Could not load allocator %s: %s", 
+                        sys_libs[i], dlerror());
+                app_error(msg);
+            }
+            nsys++;
+            continue;
+        }
+        for (j = 0; known_allocators[j] && nsys < MAXSYSALLOCS; j++)
+            if (load_sysalloc(&sysallocs[nsys], known_allocators[j]))
+                nsys++;
+    }
+
     /*
-     * Optionally run and evaluate the libc malloc package 
+     * Optionally run and evaluate libc malloc and the other
+     * system allocators
      */
-    if (run_libc) {
+    for (a = 0; a < nsys; a++) {
         if (verbose > 1)
-            printf("\nTesting libc malloc\n");
+            printf("\nTesting %s malloc\n", sysallocs[a].name);
 	
-        /* Allocate libc stats array, with one stats_t struct per tracefile */
-        libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-        if (libc_stats == NULL)
-            unix_error("libc_stats calloc in main failed");
+        /* Allocate its stats array, with one stats_t struct per tracefile */
+        sys_stats[a] = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+        if (sys_stats[a] == NULL)
+            unix_error("sys_stats calloc in main failed");
+
+        /* 
+         * Measure every footprint before the first timing run, so that 
+         * the timing runs' memory doesn't count toward the footprints
+         */
+        for (i=0; i < num_tracefiles; i++) {
+            trace = read_trace(tracedir, tracefiles[i], verbose);
+            if (verbose > 1)
+                printf("Measuring %s malloc footprint.\n", sysallocs[a].name);
+            eval_libc_footprint(trace, &sysallocs[a], &sys_stats[a][i]);
+            free_trace(trace);
+        }
 	
-        /* Evaluate the libc malloc package using the K-best scheme */
+        /* Evaluate the package using the K-best scheme */
         for (i=0; i < num_tracefiles; i++) {
-            trace = read_trace(tracedir, tracefiles[i]);
-            libc_stats[i].ops = trace->num_ops;
+            trace = read_trace(tracedir, tracefiles[i], verbose);
+            sys_stats[a][i].ops = trace->num_ops;
+            sys_stats[a][i].weight = trace->weight;
             if (verbose > 1)
-                printf("Checking libc malloc for correctness, ");
-            libc_stats[i].valid = eval_libc_valid(trace, i);
-            if (libc_stats[i].valid) {
+                printf("Checking %s malloc for correctness, ", 
+                       sysallocs[a].name);
+            sys_stats[a][i].valid = eval_libc_valid(trace, i, &sysallocs[a]);
+            if (sys_stats[a][i].valid) {
                 speed_params.trace = trace;
+                speed_params.alloc = &sysallocs[a];
                 if (verbose > 1)
                     printf("and performance.\n");
-                libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+                for (r = 0; r < reps; r++)
+                    add_sample(&sys_stats[a][i], 
+                               fsecs(eval_libc_speed, &speed_params));
             }
             free_trace(trace);
         }
 
-        /* Display the libc results in a compact table */
+        /* Display the results in a compact table */
         if (verbose) {
-            printf("\nResults for libc malloc:\n");
-            printresults(num_tracefiles, libc_stats);
+            printf("\nResults for %s malloc:\n", sysallocs[a].name);
+            printresults(num_tracefiles, sys_stats[a]);
         }
     }
 
@@ -289,20 +672,97 @@ int main(int argc, char **argv)
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
-        trace = read_trace(tracedir, tracefiles[i]);
+        trace = read_trace(tracedir, tracefiles[i], verbose);
         mm_stats[i].ops = trace->num_ops;
+        mm_stats[i].weight = trace->weight;
         if (verbose > 1)
             printf("Checking mm_malloc for correctness, ");
-        mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
+        mm_stats[i].valid = eval_mm_valid(trace, i, &ranges, &fused_util);
         if (mm_stats[i].valid) {
             if (verbose > 1)
                 printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+            if (fused)
+                mm_stats[i].util = fused_util;
+            else {
+                mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+                if (mm_stats[i].util != fused_util)
+                    printf("WARNING [trace %d]: util was %.2f%% in the "
+                           "correctness pass but %.2f%% on its own\n", i,
+                           fused_util*100.0, mm_stats[i].util*100.0);
+            }
+            add_metric(&mm_stats[i], "heapsize", (double)mem_heapsize());
+            if (run_oracle) {
+                oracle_heap = oracle_heapsize(trace, ALIGNMENT, NULL);
+                add_metric(&mm_stats[i], "oracle_heap", oracle_heap);
+                if (oracle_heap > 0) /* not if the trace allocates nothing */
+                    add_metric(&mm_stats[i], "oracle_util", mm_stats[i].util *
+                               mem_heapsize() / oracle_heap);
+            }
+            if (frag_report)
+                eval_mm_frag(trace, i, &mm_stats[i]);
             speed_params.trace = trace;
             speed_params.ranges = ranges;
+            speed_params.ckpt = NULL;
             if (verbose > 1)
                 printf("and performance.\n");
-            mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+
+            /*
+             * With -s, replay the requests before the checkpoint once,
+             * and time only the rest: each run restores the checkpoint,
+             * and the time restoring takes on its own is subtracted
+             */
+            if (ckpt_arg) {
+                long op = ckpt_pct ? ckpt_n * trace->num_ops / 100 : ckpt_n;
+
+                if (op >= trace->num_ops) {
+                    printf("-s %s leaves no requests of %s to time\n",
+                           ckpt_arg, tracefiles[i]);
+                    exit(1);
+                }
+                ckpt.op = (int)op;
+                take_checkpoint(trace, ckpt.op, ckpt_file, &ckpt);
+                speed_params.ckpt = &ckpt;
+                mm_stats[i].ops = trace->num_ops - ckpt.op;
+                if (verbose > 1)
+                    printf("Timing from request %d, restoring %lu heap "
+                           "bytes.\n", ckpt.op, 
+                           (unsigned long)ckpt.heap.size);
+            }
+
+            /* 
+             * When comparing against a baseline program, alternate its 
+             * runs with ours so both see the same machine conditions 
+             */
+            for (r = 0; r < reps; r++) {
+                if (baseline_prog)
+                    run_baseline(baseline_prog, tracedir, tracefiles[i],
+                                 &base_stats[i]);
+                if (!ckpt_arg) {
+                    add_sample(&mm_stats[i], 
+                               fsecs(eval_mm_speed, &speed_params));
+                    continue;
+                }
+                secs = fsecs(eval_mm_resume, &speed_params) -
+                    fsecs(eval_mm_restore, &speed_params);
+                add_sample(&mm_stats[i], secs > 1e-9 ? secs : 1e-9);
+            }
+
+            /* The event ring now holds the last timing run's events */
+            if (event_dir)
+                dump_events(event_dir, tracefiles[i]);
+
+            /* Sample where eval_mm_speed spends its time */
+            if (prof_fp) {
+                prof_reset();
+                r = prof_run(ckpt_arg ? eval_mm_resume : eval_mm_speed,
+                             &speed_params, PROF_SECS);
+                printf("\nProfile of trace %d (%s), %d samples:\n", 
+                       i, tracefiles[i], r);
+                prof_print(PROF_TOP);
+                prof_write_folded(prof_fp, basename_of(tracefiles[i]));
+            }
+            if (speed_params.ckpt)
+                free_checkpoint(&ckpt);
         }
         free_trace(trace);
     }
@@ -312,37 +772,63 @@ int main(int argc, char **argv)
         printf("\nResults for mm malloc:\n");
         printresults(num_tracefiles, mm_stats);
         printf("\n");
+        if (nsys > 0) {
+            printutil(num_tracefiles, mm_stats, nsys, sysallocs, sys_stats);
+            printf("\n");
+        }
+        if (run_oracle) {
+            printoracle(num_tracefiles, mm_stats);
+            printf("\n");
+        }
+    }
+
+    if (prof_fp)
+        fclose(prof_fp);
+
+    /* Write the machine-readable results */
+    if (json_file)
+        write_json(json_file, tracefiles, num_tracefiles, 
+                   nsys, sysallocs, sys_stats, mm_stats);
+    if (csv_file)
+        write_csv(csv_file, tracefiles, num_tracefiles, 
+                  nsys, sysallocs, sys_stats, mm_stats);
+
+    /* Compare with the baseline and flag significant regressions */
+    if (base_stats) {
+        printf("\nComparison with baseline:\n");
+        regressions = compare_results(num_tracefiles, base_stats, mm_stats);
+        printf("Regressions: %d\n\n", regressions);
     }
 
     /* 
-     * Accumulate the aggregate statistics for the student's mm package 
+     * Accumulate the aggregate statistics for the student's mm package,
+     * weighting each trace by the weight in its header
      */
-    secs = 0;
-    ops = 0;
-    util = 0;
     numcorrect = 0;
-    for (i=0; i < num_tracefiles; i++) {
-        secs += mm_stats[i].secs;
-        ops += mm_stats[i].ops;
-        util += mm_stats[i].util;
+    for (i=0; i < num_tracefiles; i++)
         if (mm_stats[i].valid)
             numcorrect++;
-    }
-    avg_mm_util = util/num_tracefiles;
 
     /* 
      * Compute and print the performance index 
      */
     if (errors == 0) {
-        avg_mm_throughput = ops/secs;
+        avg_mm_util = weighted_util(num_tracefiles, mm_stats);
+        avg_mm_throughput = weighted_thruput(num_tracefiles, mm_stats);
+        ceiling = libc_thruput(tracefiles, num_tracefiles, 
+                               run_libc ? sys_stats[0] : NULL, remeasure);
+        if (verbose)
+            printf("Weighted util %.0f%%, throughput %.0f Kops "
+                   "(libc on this host: %.0f Kops)\n", avg_mm_util*100.0,
+                   avg_mm_throughput/1e3, ceiling/1e3);
 
         p1 = UTIL_WEIGHT * avg_mm_util;
-        if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
+        if (avg_mm_throughput > ceiling) {
             p2 = (double)(1.0 - UTIL_WEIGHT);
         } 
         else {
             p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-                (avg_mm_throughput/AVG_LIBC_THRUPUT);
+                (avg_mm_throughput/ceiling);
         }
 	
         perfindex = (p1 + p2)*100.0;
@@ -362,27 +848,75 @@ int main(int argc, char **argv)
         printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    exit(regressions ? 1 : 0);
 }
 
 
 /*****************************************************************
  * The following routines manipulate the range list, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range list to detect any overlapping allocated blocks. It is a
+ * treap, so that checking and updating it take logarithmic time even
+ * with millions of blocks allocated.
  ****************************************************************/
 
+static unsigned range_prio(void)
+{
+    static unsigned x = 2463534242U;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+/*
+ * range_split - Split the treap t into the ranges below lo and the rest
+ */
+static void range_split(range_t *t, char *lo, range_t **a, range_t **b)
+{
+    if (t == NULL) {
+        *a = *b = NULL;
+        return;
+    }
+    if (t->lo < lo) {
+        range_split(t->right, lo, &t->right, b);
+        *a = t;
+    }
+    else {
+        range_split(t->left, lo, a, &t->left);
+        *b = t;
+    }
+}
+
+/*
+ * range_merge - Join the treaps a and b, all of whose ranges are above a's
+ */
+static range_t *range_merge(range_t *a, range_t *b)
+{
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+    if (a->prio > b->prio) {
+        a->right = range_merge(a->right, b);
+        return a;
+    }
+    b->left = range_merge(a, b->left);
+    return b;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list. 
+ *     The heap's extent is heap_lo to heap_hi, or unknown if heap_lo is NULL.
  */
 static int add_range(range_t **ranges, char *lo, int size, 
-                     int tracenum, int opnum)
+                     int tracenum, int opnum, char *heap_lo, char *heap_hi)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *a, *b;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -396,18 +930,21 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    if (heap_lo && ((lo < heap_lo) || (lo > heap_hi) || 
+                    (hi < heap_lo) || (hi > heap_hi))) {
         sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
-                lo, hi, mem_heap_lo(), mem_heap_hi());
+                lo, hi, heap_lo, heap_hi);
         malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
+    /* 
+     * The payload must not overlap any other payloads. The ranges are
+     * disjoint, so only the ones just below and just above lo can
+     * overlap it, and the search for lo passes both.
+     */
+    for (p = *ranges;  p != NULL;  p = (lo < p->lo) ? p->left : p->right) {
+        if (lo <= p->hi && hi >= p->lo) {
             sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
                     lo, hi, p->lo, p->hi);
             malloc_error(tracenum, opnum, msg);
@@ -421,10 +958,12 @@ static int add_range(range_t **ranges, char *lo, int size,
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
         unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->left = p->right = NULL;
+    p->prio = range_prio();
+    range_split(*ranges, lo, &a, &b);
+    *ranges = range_merge(range_merge(a, p), b);
     return 1;
 }
 
@@ -434,17 +973,12 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
-    range_t **prevpp = ranges;
-    // int size;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-            *prevpp = p->next;
-            // size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    while ((p = *ranges) != NULL && p->lo != lo)
+        ranges = (lo < p->lo) ? &p->left : &p->right;
+    if (p) {
+        *ranges = range_merge(p->left, p->right);
+        free(p);
     }
 }
 
@@ -453,13 +987,11 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
-
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (*ranges == NULL)
+        return;
+    clear_ranges(&(*ranges)->left);
+    clear_ranges(&(*ranges)->right);
+    free(*ranges);
     *ranges = NULL;
 }
 
@@ -468,114 +1000,18 @@ static void clear_ranges(range_t **ranges)
  * The following routines manipulate tracefiles
  *********************************************/
 
-/*
- * read_trace - read a trace file and store it in memory
- */
-static trace_t *read_trace(char *tracedir, char *filename)
-{
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    int index, size;
-    int max_index = 0;
-    int op_index;
-    int scan_result = 1;
-
-    if (verbose > 1)
-        printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-        unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-        sprintf(msg, "Could not open %s in read_trace", path);
-        unix_error(msg);
-    }
-    scan_result &= fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    scan_result &= fscanf(tracefile, "%d", &(trace->num_ids));     
-    scan_result &= fscanf(tracefile, "%d", &(trace->num_ops));     
-    scan_result &= fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-        unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-         (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-        unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-         (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-        unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-        switch(type[0]) {
-        case 'a':
-            scan_result &= fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'r':
-            scan_result &= fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = REALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'f':
-            scan_result &= fscanf(tracefile, "%ud", &index);
-            trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
-            break;
-        default:
-            printf("Bogus type character (%c) in tracefile %s\n", 
-                   type[0], path);
-            exit(1);
-        }
-        op_index++;
-	
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
-}
-
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
-}
-
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * eval_mm_valid - Check the mm malloc package for correctness. If util
+ *     is not NULL, the same pass also measures the space utilization,
+ *     as eval_mm_util does, and sets trace->peak_op.
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges,
+                         double *util) 
 {
     int i, j;
     int index;
@@ -584,13 +1020,15 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     char *newp;
     char *oldp;
     char *p;
+    size_t total_size = 0, max_total_size = 0;
     
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
     clear_ranges(ranges);
+    trace->peak_op = 0;
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (init_mm(trace) < 0) {
         malloc_error(tracenum, 0, "mm_init failed.");
         return 0;
     }
@@ -615,7 +1053,8 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
              * to the range list if OK. The block must be  be aligned properly,
              * and must not overlap any currently allocated block. 
              */ 
-            if (add_range(ranges, p, size, tracenum, i) == 0)
+            if (add_range(ranges, p, size, tracenum, i, 
+                          mem_heap_lo(), mem_heap_hi()) == 0)
                 return 0;
 	    
             /* ADDED: cgw
@@ -628,6 +1067,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
             /* Remember region */
             trace->blocks[index] = p;
             trace->block_sizes[index] = size;
+            total_size += size;
             break;
 
         case REALLOC: /* mm_realloc */
@@ -643,7 +1083,8 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
             remove_range(ranges, oldp);
 	    
             /* Check new block for correctness and add it to range list */
-            if (add_range(ranges, newp, size, tracenum, i) == 0)
+            if (add_range(ranges, newp, size, tracenum, i,
+                          mem_heap_lo(), mem_heap_hi()) == 0)
                 return 0;
 	    
             /* ADDED: cgw
@@ -654,7 +1095,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
             oldsize = trace->block_sizes[index];
             if (size < oldsize) oldsize = size;
             for (j = 0; j < oldsize; j++) {
-                if (newp[j] != (index & 0xFF)) {
+                if ((unsigned char)newp[j] != (index & 0xFF)) {
                     malloc_error(tracenum, i, "mm_realloc did not preserve the "
                                  "data from old block");
                     return 0;
@@ -663,6 +1104,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
             memset(newp, index & 0xFF, size);
 
             /* Remember region */
+            total_size += size - trace->block_sizes[index];
             trace->blocks[index] = newp;
             trace->block_sizes[index] = size;
             break;
@@ -673,14 +1115,23 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
             p = trace->blocks[index];
             remove_range(ranges, p);
             mm_free(p);
+            total_size -= trace->block_sizes[index];
             break;
 
         default:
             app_error("Nonexistent request type in eval_mm_valid");
         }
 
+        /* Track the live payload bytes at peak for the utilization */
+        if (total_size > max_total_size) {
+            max_total_size = total_size;
+            trace->peak_op = i;
+        }
     }
 
+    if (util)
+        *util = (double)max_total_size / (double)mem_heapsize();
+
     /* As far as we know, this is a valid malloc package */
     return 1;
 }
@@ -708,8 +1159,9 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (init_mm(trace) < 0)
         app_error("mm_init failed in eval_mm_util");
+    trace->peak_op = 0;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
@@ -730,8 +1182,10 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
             total_size += size;
 	    
             /* Update statistics */
-            max_total_size = (total_size > max_total_size) ?
-                total_size : max_total_size;
+            if (total_size > max_total_size) {
+                max_total_size = total_size;
+                trace->peak_op = i;
+            }
             break;
 
         case REALLOC: /* mm_realloc */
@@ -752,8 +1206,10 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
             total_size += (newsize - oldsize);
 	    
             /* Update statistics */
-            max_total_size = (total_size > max_total_size) ?
-                total_size : max_total_size;
+            if (total_size > max_total_size) {
+                max_total_size = total_size;
+                trace->peak_op = i;
+            }
             break;
 
         case FREE: /* mm_free */
@@ -778,6 +1234,202 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     return ((double)max_total_size / (double)mem_heapsize());
 }
 
+/*
+ * The following routines support eval_mm_frag, which takes apart the
+ * heap at the moment the trace has the most payload bytes live.
+ */
+
+/* A live block: payload offset and requested size */
+typedef struct {
+    size_t offset;
+    size_t size;
+} live_t;
+
+/* State shared with the heap walk callback */
+typedef struct {
+    live_t *live;       /* live blocks, sorted by offset */
+    int nlive;
+    frag_t classes[NFRAGCLASSES];
+    double holes;       /* bytes in free blocks */
+    int nholes;
+    double largest_hole;
+    double unknown;     /* allocated blocks the trace does not own */
+} frag_walk_t;
+
+static int cmp_live(const void *a, const void *b)
+{
+    const live_t *x = a, *y = b;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/*
+ * frag_class - Size class of a request: 1-16 bytes is class 0, and 
+ *     each following class doubles the upper bound
+ */
+static int frag_class(size_t size)
+{
+    int c = 0;
+    size_t bound = 16;
+
+    while (size > bound && c < NFRAGCLASSES - 1) {
+        bound *= 2;
+        c++;
+    }
+    return c;
+}
+
+/*
+ * frag_block - mm_heap_walk callback that attributes one block's bytes
+ */
+static int frag_block(const mm_block_t *block, void *ctx)
+{
+    frag_walk_t *w = ctx;
+    live_t key, *l;
+    frag_t *f;
+    size_t asize;
+
+    if (!block->allocated) {
+        w->holes += block->size;
+        w->nholes++;
+        if (block->size > w->largest_hole)
+            w->largest_hole = block->size;
+        return 0;
+    }
+    key.offset = block->offset;
+    l = bsearch(&key, w->live, w->nlive, sizeof(live_t), cmp_live);
+    if (l == NULL) {
+        w->unknown += block->size;
+        return 0;
+    }
+    asize = mm_adjusted_size(l->size);
+    f = &w->classes[frag_class(l->size)];
+    f->blocks++;
+    f->payload += l->size;
+    f->overhead += mm_block_overhead();
+    f->rounding += asize - mm_block_overhead() - l->size;
+    f->slack += block->size - asize;
+    return 0;
+}
+
+/*
+ * eval_mm_frag - Replay the trace up to its peak of live payload bytes,
+ *     then walk the heap and attribute every byte to requested payload,
+ *     rounding, header/footer overhead, unsplit slack, or free holes. 
+ *     Allocated bytes are broken down by request size class. The totals
+ *     are also recorded as metrics for -j/-c.
+ */
+static void eval_mm_frag(trace_t *trace, int tracenum, stats_t *stats)
+{
+    int i, c, index;
+    char *live_flags;
+    char *p;
+    frag_walk_t w;
+    frag_t total;
+    double heap, other;
+    char label[32];
+
+    if ((live_flags = calloc(trace->num_ids, 1)) == NULL)
+        unix_error("calloc failed in eval_mm_frag");
+
+    mem_reset_brk();
+    if (init_mm(trace) < 0)
+        app_error("mm_init failed in eval_mm_frag");
+    for (i = 0; i <= trace->peak_op && i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+        case ALLOC:
+            if ((p = mm_malloc(trace->ops[i].size)) == NULL)
+                app_error("mm_malloc failed in eval_mm_frag");
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = trace->ops[i].size;
+            live_flags[index] = 1;
+            break;
+        case REALLOC:
+            if ((p = mm_realloc(trace->blocks[index], trace->ops[i].size)) == NULL)
+                app_error("mm_realloc failed in eval_mm_frag");
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = trace->ops[i].size;
+            break;
+        case FREE:
+            mm_free(trace->blocks[index]);
+            live_flags[index] = 0;
+            break;
+        default:
+            app_error("Nonexistent request type in eval_mm_frag");
+        }
+    }
+
+    /* Index the live blocks by payload offset for the heap walk */
+    memset(&w, 0, sizeof(w));
+    if ((w.live = malloc(trace->num_ids * sizeof(live_t))) == NULL)
+        unix_error("malloc failed in eval_mm_frag");
+    for (index = 0; index < trace->num_ids; index++)
+        if (live_flags[index]) {
+            w.live[w.nlive].offset = trace->blocks[index] - (char *)mem_heap_lo();
+            w.live[w.nlive].size = trace->block_sizes[index];
+            w.nlive++;
+        }
+    qsort(w.live, w.nlive, sizeof(live_t), cmp_live);
+    mm_heap_walk(frag_block, &w);
+
+    memset(&total, 0, sizeof(total));
+    for (c = 0; c < NFRAGCLASSES; c++) {
+        total.blocks += w.classes[c].blocks;
+        total.payload += w.classes[c].payload;
+        total.rounding += w.classes[c].rounding;
+        total.overhead += w.classes[c].overhead;
+        total.slack += w.classes[c].slack;
+    }
+    heap = mem_heapsize();
+    other = heap - total.payload - total.rounding - total.overhead -
+        total.slack - w.holes;
+
+    printf("\nFragmentation of trace %d at peak (op %d), heap %.0f bytes:\n",
+           tracenum, trace->peak_op, heap);
+    printf("%-12s%8s%10s%10s%10s%10s\n", "request", "blocks", "payload", 
+           "rounding", "overhead", "slack");
+    for (c = 0; c < NFRAGCLASSES; c++) {
+        if (w.classes[c].blocks == 0)
+            continue;
+        if (c == NFRAGCLASSES - 1)
+            sprintf(label, "%d+", (16 << (c-1)) + 1);
+        else
+            sprintf(label, "%d-%d", c ? (16 << (c-1)) + 1 : 1, 16 << c);
+        printf("%-12s%8d%10.0f%10.0f%10.0f%10.0f\n", label,
+               w.classes[c].blocks, w.classes[c].payload, 
+               w.classes[c].rounding, w.classes[c].overhead, 
+               w.classes[c].slack);
+    }
+    printf("%-12s%8d%10.0f%10.0f%10.0f%10.0f\n", "total", total.blocks,
+           total.payload, total.rounding, total.overhead, total.slack);
+    printf("%-12s%7.1f%%%9.1f%%%9.1f%%%9.1f%%\n", "% of heap", 
+           100.0*total.payload/heap, 100.0*total.rounding/heap, 
+           100.0*total.overhead/heap, 100.0*total.slack/heap);
+    printf("free holes: %.0f bytes (%.1f%%) in %d blocks, largest %.0f\n",
+           w.holes, 100.0*w.holes/heap, w.nholes, w.largest_hole);
+    printf("prologue, epilogue and unowned blocks: %.0f bytes\n", other);
+
+    add_metric(stats, "frag_payload", total.payload);
+    add_metric(stats, "frag_rounding", total.rounding);
+    add_metric(stats, "frag_overhead", total.overhead);
+    add_metric(stats, "frag_slack", total.slack);
+    add_metric(stats, "frag_holes", w.holes);
+    add_metric(stats, "frag_heapsize", heap);
+
+    free(w.live);
+    free(live_flags);
+}
+
+/*
+ * init_mm - Initialize the mm package for a trace, with a heap of the
+ *     trace's suggested size when -H is given
+ */
+static int init_mm(trace_t *trace)
+{
+    if (presize)
+        return mm_init_hint(trace->sugg_heapsize);
+    return mm_init();
+}
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -785,17 +1437,26 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (init_mm(trace) < 0) 
         app_error("mm_init failed in eval_mm_speed");
 
+    replay_mm(trace, 0, trace->num_ops);
+}
+
+/*
+ * replay_mm - Run requests start to end-1 of the trace through mm
+ */
+static void replay_mm(trace_t *trace, int start, int end)
+{
+    int i, index, size, newsize;
+    char *p, *newp, *oldp, *block;
+
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
+    for (i = start;  i < end;  i++)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
@@ -822,17 +1483,81 @@ static void eval_mm_speed(void *ptr)
             break;
 
         default:
-            app_error("Nonexistent request type in eval_mm_valid");
+            app_error("Nonexistent request type in eval_mm_speed");
         }
 }
 
+/*
+ * take_checkpoint - Replay the requests before op from a new heap, and
+ *    save the heap, mm's state and the block payloads at that point.
+ *    The heap is copied into path, if not NULL, instead of memory.
+ */
+static void take_checkpoint(trace_t *trace, int op, char *path,
+                            checkpoint_t *ckpt)
+{
+    mem_reset_brk();
+    if (init_mm(trace) < 0)
+        app_error("mm_init failed in take_checkpoint");
+    replay_mm(trace, 0, op);
+
+    ckpt->op = op;
+    if (mem_checkpoint(&ckpt->heap, path) < 0) {
+        sprintf(msg, "Could not write checkpoint to %s", path);
+        unix_error(msg);
+    }
+    if ((ckpt->mm_state = malloc(mm_state_size())) == NULL ||
+        (ckpt->blocks = malloc(trace->num_ids * sizeof(char *))) == NULL)
+        unix_error("malloc failed in take_checkpoint");
+    mm_save_state(ckpt->mm_state);
+    memcpy(ckpt->blocks, trace->blocks, trace->num_ids * sizeof(char *));
+}
+
+/*
+ * restore_checkpoint - Put the heap, mm and the block payloads back
+ *    as they were at the checkpoint, in time linear in the heap size
+ */
+static void restore_checkpoint(trace_t *trace, checkpoint_t *ckpt)
+{
+    mem_restore(&ckpt->heap);
+    mm_restore_state(ckpt->mm_state);
+    memcpy(trace->blocks, ckpt->blocks, trace->num_ids * sizeof(char *));
+}
+
+static void free_checkpoint(checkpoint_t *ckpt)
+{
+    mem_snapshot_free(&ckpt->heap);
+    free(ckpt->mm_state);
+    free(ckpt->blocks);
+}
+
+/*
+ * eval_mm_restore - Time restoring the checkpoint alone, which
+ *    eval_mm_resume's time is corrected by
+ */
+static void eval_mm_restore(void *ptr)
+{
+    restore_checkpoint(((speed_t *)ptr)->trace, ((speed_t *)ptr)->ckpt);
+}
+
+/*
+ * eval_mm_resume - Like eval_mm_speed, but starting from the checkpoint
+ */
+static void eval_mm_resume(void *ptr)
+{
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    checkpoint_t *ckpt = ((speed_t *)ptr)->ckpt;
+
+    restore_checkpoint(trace, ckpt);
+    replay_mm(trace, ckpt->op, trace->num_ops);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
  *    We'll be conservative and terminate if any libc malloc call fails.
  *
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static int eval_libc_valid(trace_t *trace, int tracenum, sysalloc_t *alloc)
 {
     int i, newsize;
     char *p, *newp, *oldp;
@@ -841,7 +1566,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
-            if ((p = malloc(trace->ops[i].size)) == NULL) {
+            if ((p = alloc->malloc(trace->ops[i].size)) == NULL) {
                 malloc_error(tracenum, i, "libc malloc failed");
                 unix_error("System message");
             }
@@ -851,7 +1576,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
         case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
             oldp = trace->blocks[trace->ops[i].index];
-            if ((newp = realloc(oldp, newsize)) == NULL) {
+            if ((newp = alloc->realloc(oldp, newsize)) == NULL) {
                 malloc_error(tracenum, i, "libc realloc failed");
                 unix_error("System message");
             }
@@ -859,7 +1584,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
             break;
 	    
         case FREE: /* free */
-            free(trace->blocks[trace->ops[i].index]);
+            alloc->free(trace->blocks[trace->ops[i].index]);
             break;
 
         default:
@@ -870,24 +1595,198 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
     return 1;
 }
 
-/* 
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+/*
+ * load_sysalloc - Load a system allocator library with dlopen and look
+ *     up its malloc, free and realloc. Returns 0 if it is not available.
  */
-static void eval_libc_speed(void *ptr)
+static int load_sysalloc(sysalloc_t *alloc, char *lib)
 {
-    int i;
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
+    void *handle;
+    char *name;
+
+    if ((handle = dlopen(lib, RTLD_NOW | RTLD_LOCAL)) == NULL)
+        return 0;
+    alloc->malloc = (void *(*)(size_t))dlsym(handle, "malloc");
+    alloc->free = (void (*)(void *))dlsym(handle, "free");
+    alloc->realloc = (void *(*)(void *, size_t))dlsym(handle, "realloc");
+    if (!alloc->malloc || !alloc->free || !alloc->realloc) {
+        dlclose(handle);
+        return 0;
+    }
+    name = strrchr(lib, '/');
+    alloc->name = strdup(name ? name + 1 : lib);
+    alloc->is_libc = 0;
+    return 1;
+}
+
+/*
+ * rss_bytes - Resident set size of this process, from /proc/self/statm
+ */
+static double rss_bytes(void)
+{
+    static int fd = -1;
+    char buf[128];
+    long size, resident;
+    int n;
+
+    if (fd < 0 && (fd = open("/proc/self/statm", O_RDONLY)) < 0)
+        return 0;
+    if ((n = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0)
+        return 0;
+    buf[n] = '\0';
+    if (sscanf(buf, "%ld %ld", &size, &resident) != 2)
+        return 0;
+    return (double)resident * getpagesize();
+}
+
+/*
+ * footprint_child - Replay the trace through a system allocator and
+ *     record result[0] = peak arena footprint (libc only), result[1] = 
+ *     peak RSS growth, and result[2] = peak live payload bytes.
+ *
+ *     The arena footprint is the most memory libc held in its arena and
+ *     in mmapped chunks, less what the rest of mdriver was using when
+ *     the replay started. RSS growth works for any allocator, but is
+ *     page-granular and also counts the pages of the trace arrays that
+ *     the replay touches for the first time. Each payload is written
+ *     as it is allocated, as a program would, since pages that are
+ *     never touched never become resident.
+ */
+static void footprint_child(trace_t *trace, sysalloc_t *alloc, 
+                            double *result)
+{
+    int i, index;
+    char *p;
+    double total_size = 0, max_total_size = 0;
+    double base_used = 0, base_rss, arena, rss;
+    double peak_arena = 0, peak_rss = 0;
+#if HAVE_MALLINFO2
+    struct mallinfo2 mi;
+
+    /* Give back the free memory left over from earlier traces */
+    malloc_trim(0);
+    mi = mallinfo2();
+    base_used = mi.uordblks + mi.hblkhd;
+#endif
+    base_rss = peak_rss = rss_bytes();
+
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+        case ALLOC:
+            if ((p = alloc->malloc(trace->ops[i].size)) == NULL)
+                unix_error("malloc failed in footprint_child");
+            memset(p, 0, trace->ops[i].size);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = trace->ops[i].size;
+            total_size += trace->ops[i].size;
+            break;
+        case REALLOC:
+            if ((p = alloc->realloc(trace->blocks[index], 
+                                    trace->ops[i].size)) == NULL)
+                unix_error("realloc failed in footprint_child");
+            if ((size_t)trace->ops[i].size > trace->block_sizes[index])
+                memset(p + trace->block_sizes[index], 0, 
+                       trace->ops[i].size - trace->block_sizes[index]);
+            total_size += (double)trace->ops[i].size - 
+                trace->block_sizes[index];
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = trace->ops[i].size;
+            break;
+        case FREE:
+            alloc->free(trace->blocks[index]);
+            total_size -= trace->block_sizes[index];
+            continue;
+        default:
+            app_error("Nonexistent request type in footprint_child");
+        }
+
+        /* The footprint can only grow after an allocation */
+        if (total_size > max_total_size)
+            max_total_size = total_size;
+#if HAVE_MALLINFO2
+        if (alloc->is_libc) {
+            mi = mallinfo2();
+            arena = mi.arena + mi.hblkhd;
+            if (arena > peak_arena)
+                peak_arena = arena;
+        }
+#endif
+        if ((rss = rss_bytes()) > peak_rss)
+            peak_rss = rss;
+    }
+    result[0] = (peak_arena > base_used) ? peak_arena - base_used : 0;
+    result[1] = peak_rss - base_rss;
+    result[2] = max_total_size;
+}
+
+/*
+ * eval_libc_footprint - Estimate how much memory a system allocator
+ *     needs for the trace, and its utilization. The replay runs in a 
+ *     child process so that it neither inherits memory from this 
+ *     allocator's timing runs nor leaves any behind.
+ */
+static void eval_libc_footprint(trace_t *trace, sysalloc_t *alloc,
+                                stats_t *stats)
+{
+    int fds[2], status;
+    double result[3];
+    pid_t pid;
+
+    fflush(stdout);
+    if (pipe(fds) < 0)
+        unix_error("pipe failed in eval_libc_footprint");
+    if ((pid = fork()) < 0)
+        unix_error("fork failed in eval_libc_footprint");
+    if (pid == 0) {
+        close(fds[0]);
+        footprint_child(trace, alloc, result);
+        if (write(fds[1], result, sizeof(result)) != sizeof(result))
+            _exit(1);
+        _exit(0);
+    }
+    close(fds[1]);
+    if (read(fds[0], result, sizeof(result)) != sizeof(result))
+        app_error("footprint measurement failed in eval_libc_footprint");
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+
+    /* 
+     * A footprint smaller than the peak live bytes was mismeasured
+     * (say, by reusing pages that were already resident), so it gives
+     * no utilization rather than one above 100%
+     */
+    if (alloc->is_libc && result[0] > 0) {
+        if (result[2] <= result[0])
+            stats->util = result[2] / result[0];
+        add_metric(stats, "footprint_arena", result[0]);
+    }
+    else if (result[1] > 0 && result[2] <= result[1])
+        stats->util = result[2] / result[1];
+    add_metric(stats, "footprint_rss", result[1]);
+    if (result[1] > 0 && result[2] <= result[1])
+        add_metric(stats, "util_rss", result[2] / result[1]);
+}
+
+/* 
+ * eval_libc_speed - This is the function that is used by fcyc() to
+ *    measure the running time of the libc malloc package on the set
+ *    of traces.
+ */
+static void eval_libc_speed(void *ptr)
+{
+    int i;
+    int index, size, newsize;
+    char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    sysalloc_t *alloc = ((speed_t *)ptr)->alloc;
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
         case ALLOC: /* malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = malloc(size)) == NULL)
+            if ((p = alloc->malloc(size)) == NULL)
                 unix_error("malloc failed in eval_libc_speed");
             trace->blocks[index] = p;
             break;
@@ -896,7 +1795,7 @@ static void eval_libc_speed(void *ptr)
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
             oldp = trace->blocks[index];
-            if ((newp = realloc(oldp, newsize)) == NULL)
+            if ((newp = alloc->realloc(oldp, newsize)) == NULL)
                 unix_error("realloc failed in eval_libc_speed\n");
 	    
             trace->blocks[index] = newp;
@@ -905,72 +1804,1571 @@ static void eval_libc_speed(void *ptr)
         case FREE: /* free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            free(block);
+            alloc->free(block);
             break;
         }
     }
 }
 
-/*************************************
- * Some miscellaneous helper routines
- ************************************/
+/*
+ * load_engine - Load an allocator engine library (see engine.h) with
+ *     dlopen. Returns NULL if it can't be loaded or isn't an engine.
+ */
+static mm_engine_t *load_engine(char *lib)
+{
+    void *handle;
+    mm_engine_t *engine;
+
+    if ((handle = dlopen(lib, RTLD_NOW | RTLD_LOCAL)) == NULL)
+        return NULL;
+    engine = (mm_engine_t *)dlsym(handle, ENGINE_SYMBOL);
+    if (!engine || engine->version != ENGINE_VERSION || !engine->init ||
+        !engine->malloc || !engine->free || !engine->realloc) {
+        dlclose(handle);
+        return NULL;
+    }
+    return engine;
+}
+
+/*
+ * eval_engine_valid - Check an allocator engine for correctness, as
+ *     eval_mm_valid does for mm
+ */
+static int eval_engine_valid(trace_t *trace, int tracenum, 
+                             mm_engine_t *engine, range_t **ranges)
+{
+    int i, j;
+    int index, size, oldsize;
+    char *p, *newp, *oldp;
+    char *lo, *hi;
+
+    clear_ranges(ranges);
+    if (engine->init() < 0) {
+        malloc_error(tracenum, 0, "engine init failed.");
+        return 0;
+    }
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* malloc */
+            if ((p = engine->malloc(size)) == NULL) {
+                malloc_error(tracenum, i, "engine malloc failed.");
+                return 0;
+            }
+            lo = engine->heap_lo ? engine->heap_lo() : NULL;
+            hi = engine->heap_hi ? engine->heap_hi() : NULL;
+            if (add_range(ranges, p, size, tracenum, i, lo, hi) == 0)
+                return 0;
+            memset(p, index & 0xFF, size);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case REALLOC: /* realloc */
+            oldp = trace->blocks[index];
+            if ((newp = engine->realloc(oldp, size)) == NULL) {
+                malloc_error(tracenum, i, "engine realloc failed.");
+                return 0;
+            }
+            remove_range(ranges, oldp);
+            lo = engine->heap_lo ? engine->heap_lo() : NULL;
+            hi = engine->heap_hi ? engine->heap_hi() : NULL;
+            if (add_range(ranges, newp, size, tracenum, i, lo, hi) == 0)
+                return 0;
+
+            /* The old data must have been copied */
+            oldsize = trace->block_sizes[index];
+            if (size < oldsize) oldsize = size;
+            for (j = 0; j < oldsize; j++) {
+                if ((unsigned char)newp[j] != (index & 0xFF)) {
+                    malloc_error(tracenum, i, "engine realloc did not "
+                                 "preserve the data from old block");
+                    return 0;
+                }
+            }
+            memset(newp, index & 0xFF, size);
+            trace->blocks[index] = newp;
+            trace->block_sizes[index] = size;
+            break;
+
+        case FREE: /* free */
+            p = trace->blocks[index];
+            remove_range(ranges, p);
+            engine->free(p);
+            break;
 
+        default:
+            app_error("Nonexistent request type in eval_engine_valid");
+        }
+    }
+    return 1;
+}
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * eval_engine_util - Utilization of an allocator engine, as 
+ *     eval_mm_util measures it for mm. 0 if the engine doesn't report
+ *     its heap size.
  */
-static void printresults(int n, stats_t *stats) 
+static double eval_engine_util(trace_t *trace, mm_engine_t *engine)
 {
-    int i;
-    double secs = 0;
-    double ops = 0;
-    double util = 0;
+    int i, index, size;
+    double total_size = 0, max_total_size = 0;
+    char *p;
 
-    /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-           "trace", " valid", "util", "ops", "secs", "Kops");
-    for (i=0; i < n; i++) {
-        if (stats[i].valid) {
-            printf("%2d%10s%5.0f%%%8.0f%10.6f%8.0f\n", 
-                   i,
-                   "yes",
-                   stats[i].util*100.0,
-                   stats[i].ops,
-                   stats[i].secs,
-                   (stats[i].ops/1e3)/stats[i].secs);
-            secs += stats[i].secs;
-            ops += stats[i].ops;
-            util += stats[i].util;
+    if (!engine->heapsize)
+        return 0;
+    if (engine->init() < 0)
+        app_error("engine init failed in eval_engine_util");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+        case ALLOC: /* malloc */
+            if ((p = engine->malloc(size)) == NULL)
+                app_error("engine malloc failed in eval_engine_util");
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            total_size += size;
+            break;
+        case REALLOC: /* realloc */
+            if ((p = engine->realloc(trace->blocks[index], size)) == NULL)
+                app_error("engine realloc failed in eval_engine_util");
+            total_size += size - trace->block_sizes[index];
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+        case FREE: /* free */
+            engine->free(trace->blocks[index]);
+            total_size -= trace->block_sizes[index];
+            break;
+        default:
+            app_error("Nonexistent request type in eval_engine_util");
         }
-        else {
-            printf("%2d%10s%6s%8s%10s%8s\n", 
-                   i,
-                   "no",
-                   "-",
-                   "-",
-                   "-",
-                   "-");
+        if (total_size > max_total_size)
+            max_total_size = total_size;
+    }
+    return max_total_size / (double)engine->heapsize();
+}
+
+/* 
+ * eval_engine_speed - This is the function that is used by fcyc() to
+ *    measure the running time of an allocator engine on a trace
+ */
+static void eval_engine_speed(void *ptr)
+{
+    int i;
+    int index;
+    char *p;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    mm_engine_t *engine = ((speed_t *)ptr)->engine;
+
+    if (engine->init() < 0)
+        app_error("engine init failed in eval_engine_speed");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+        case ALLOC: /* malloc */
+            if ((p = engine->malloc(trace->ops[i].size)) == NULL)
+                app_error("engine malloc failed in eval_engine_speed");
+            trace->blocks[index] = p;
+            break;
+        case REALLOC: /* realloc */
+            if ((p = engine->realloc(trace->blocks[index],
+                                     trace->ops[i].size)) == NULL)
+                app_error("engine realloc failed in eval_engine_speed");
+            trace->blocks[index] = p;
+            break;
+        case FREE: /* free */
+            engine->free(trace->blocks[index]);
+            break;
         }
     }
+}
 
-    /* Print the aggregate results for the set of traces */
-    if (errors == 0) {
-        printf("%12s%5.0f%%%8.0f%10.6f%8.0f\n", 
-               "Total       ",
-               (util/n)*100.0,
-               ops, 
-               secs,
-               (ops/1e3)/secs);
+/************************************************************
+ * The following routines record per-trace results, write them
+ * in machine-readable form, and compare them with a baseline.
+ ************************************************************/
+
+/*
+ * add_sample - Record the time of one timing repetition. The reported
+ *     secs is the fastest repetition, in keeping with the K-best scheme.
+ */
+static void add_sample(stats_t *stats, double secs)
+{
+    if (stats->nsamples == MAXREPS)
+        return;
+    if (stats->nsamples == 0 || secs < stats->secs)
+        stats->secs = secs;
+    stats->samples[stats->nsamples++] = secs;
+}
+
+/*
+ * add_metric - Record an extra named measurement for a trace
+ */
+static void add_metric(stats_t *stats, char *name, double value)
+{
+    if (stats->nmetrics == MAXMETRICS)
+        app_error("Too many metrics in add_metric");
+    stats->metrics[stats->nmetrics].name = name;
+    stats->metrics[stats->nmetrics].value = value;
+    stats->nmetrics++;
+}
+
+/*
+ * basename_of - Trace file name without its directory, which is how
+ *     results from different runs are matched up
+ */
+static char *basename_of(char *path)
+{
+    char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/*
+ * write_json_stats - Write one trace's results as a single-line JSON object
+ */
+static void write_json_stats(FILE *fp, char *allocator, int tracenum,
+                             char *file, stats_t *stats, int last)
+{
+    int j;
+
+    fprintf(fp, "{\"allocator\": \"%s\", \"trace\": %d, \"file\": \"",
+            allocator, tracenum);
+    for (; *file; file++) {
+        if (*file == '"' || *file == '\\')
+            fputc('\\', fp);
+        fputc(*file, fp);
     }
-    else {
-        printf("%12s%6s%8s%10s%8s\n", 
-               "Total       ",
-               "-", 
-               "-", 
-               "-", 
-               "-");
+    fprintf(fp, "\", \"valid\": %d, \"util\": %.6f, \"ops\": %.0f, "
+            "\"secs\": %.9g, \"kops\": %.3f, \"samples\": [",
+            stats->valid, stats->util, stats->ops, stats->secs,
+            stats->valid ? (stats->ops/1e3)/stats->secs : 0.0);
+    for (j = 0; j < stats->nsamples; j++)
+        fprintf(fp, "%s%.9g", j ? ", " : "", stats->samples[j]);
+    fprintf(fp, "], \"metrics\": {");
+    for (j = 0; j < stats->nmetrics; j++)
+        fprintf(fp, "%s\"%s\": %.9g", j ? ", " : "",
+                stats->metrics[j].name, stats->metrics[j].value);
+    fprintf(fp, "}}%s\n", last ? "" : ",");
+}
+
+/*
+ * write_json - Write the results for every trace to a JSON file. Each
+ *     trace is one object on its own line, so that read_baseline can 
+ *     parse the file back without a general JSON parser.
+ */
+static void write_json(char *path, char **tracefiles, int n, int nsys,
+                       sysalloc_t *sysallocs, stats_t **sys_stats, 
+                       stats_t *mm_stats)
+{
+    FILE *fp;
+    int i, a;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        sprintf(msg, "Could not open %s in write_json", path);
+        unix_error(msg);
+    }
+    fprintf(fp, "{\"results\": [\n");
+    for (a = 0; a < nsys; a++)
+        for (i = 0; i < n; i++)
+            write_json_stats(fp, sysallocs[a].name, i, tracefiles[i], 
+                             &sys_stats[a][i], 0);
+    for (i = 0; i < n; i++)
+        write_json_stats(fp, "mm", i, tracefiles[i], &mm_stats[i], i == n-1);
+    fprintf(fp, "]}\n");
+    fclose(fp);
+}
+
+/*
+ * write_csv_stats - Write one trace's results as a CSV row. The samples
+ *     are separated by semicolons, and the metric columns follow the
+ *     names in the header row.
+ */
+static void write_csv_stats(FILE *fp, char *allocator, int tracenum, 
+                            char *file, stats_t *stats, 
+                            char **names, int nnames)
+{
+    int j, k;
+
+    fprintf(fp, "%s,%d,%s,%d,%.6f,%.0f,%.9g,%.3f,", allocator, tracenum, 
+            file, stats->valid, stats->util, stats->ops, stats->secs,
+            stats->valid ? (stats->ops/1e3)/stats->secs : 0.0);
+    for (j = 0; j < stats->nsamples; j++)
+        fprintf(fp, "%s%.9g", j ? ";" : "", stats->samples[j]);
+    for (k = 0; k < nnames; k++) {
+        fputc(',', fp);
+        for (j = 0; j < stats->nmetrics; j++)
+            if (!strcmp(stats->metrics[j].name, names[k]))
+                fprintf(fp, "%.9g", stats->metrics[j].value);
+    }
+    fputc('\n', fp);
+}
+
+/*
+ * write_csv - Write the results for every trace to a CSV file
+ */
+static void add_names(char **names, int *nnames, stats_t *stats, int n)
+{
+    int i, j, k;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < stats[i].nmetrics; j++) {
+            for (k = 0; k < *nnames; k++)
+                if (!strcmp(names[k], stats[i].metrics[j].name))
+                    break;
+            if (k == *nnames && *nnames < 2*MAXMETRICS)
+                names[(*nnames)++] = stats[i].metrics[j].name;
+        }
+}
+
+static void write_csv(char *path, char **tracefiles, int n, int nsys,
+                      sysalloc_t *sysallocs, stats_t **sys_stats, 
+                      stats_t *mm_stats)
+{
+    FILE *fp;
+    char *names[2*MAXMETRICS];
+    int nnames = 0;
+    int i, k, a;
+
+    /* The metric columns are the union of every trace's metric names */
+    for (a = 0; a < nsys; a++)
+        add_names(names, &nnames, sys_stats[a], n);
+    add_names(names, &nnames, mm_stats, n);
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        sprintf(msg, "Could not open %s in write_csv", path);
+        unix_error(msg);
     }
+    fprintf(fp, "allocator,trace,file,valid,util,ops,secs,kops,samples");
+    for (k = 0; k < nnames; k++)
+        fprintf(fp, ",%s", names[k]);
+    fputc('\n', fp);
+    for (a = 0; a < nsys; a++)
+        for (i = 0; i < n; i++)
+            write_csv_stats(fp, sysallocs[a].name, i, tracefiles[i], 
+                            &sys_stats[a][i], names, nnames);
+    for (i = 0; i < n; i++)
+        write_csv_stats(fp, "mm", i, tracefiles[i], &mm_stats[i], 
+                        names, nnames);
+    fclose(fp);
+}
+
+/*
+ * json_number - Find "key": in a line written by write_json_stats and 
+ *     return the number that follows it in *val. Returns 0 if missing.
+ */
+static int json_number(char *line, char *key, double *val)
+{
+    char pattern[MAXLINE];
+    char *p;
+
+    sprintf(pattern, "\"%s\": ", key);
+    if ((p = strstr(line, pattern)) == NULL)
+        return 0;
+    *val = strtod(p + strlen(pattern), NULL);
+    return 1;
+}
 
+/*
+ * json_string - Copy the string value of "key": in a line written by 
+ *     write_json_stats into buf. Returns 0 if missing.
+ */
+static int json_string(char *line, char *key, char *buf, int len)
+{
+    char pattern[MAXLINE];
+    char *p;
+    int i = 0;
+
+    sprintf(pattern, "\"%s\": \"", key);
+    if ((p = strstr(line, pattern)) == NULL)
+        return 0;
+    for (p += strlen(pattern); *p && *p != '"' && i < len-1; p++) {
+        if (*p == '\\' && p[1])
+            p++;
+        buf[i++] = *p;
+    }
+    buf[i] = '\0';
+    return 1;
+}
+
+/*
+ * read_baseline - Load the mm results of a JSON file written by -j, 
+ *     and add them to the baseline stats of the traces with the same 
+ *     file names. Samples are appended, so this can be called once per
+ *     baseline run.
+ */
+static void read_baseline(char *path, char **tracefiles, int n,
+                          stats_t *base_stats)
+{
+    FILE *fp;
+    char line[16*MAXLINE];
+    char file[MAXLINE];
+    char allocator[MAXLINE];
+    double val;
+    char *p, *end;
+    stats_t *stats;
+    int i;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        sprintf(msg, "Could not open %s in read_baseline", path);
+        unix_error(msg);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (!json_string(line, "allocator", allocator, MAXLINE) ||
+            strcmp(allocator, "mm") ||
+            !json_string(line, "file", file, MAXLINE))
+            continue;
+        for (i = 0; i < n; i++)
+            if (!strcmp(basename_of(file), basename_of(tracefiles[i])))
+                break;
+        if (i == n)
+            continue;
+        stats = &base_stats[i];
+
+        if (json_number(line, "valid", &val))
+            stats->valid = (int)val;
+        if (json_number(line, "util", &val))
+            stats->util = val;
+        if (json_number(line, "ops", &val))
+            stats->ops = val;
+        if ((p = strstr(line, "\"samples\": [")) != NULL) {
+            p += strlen("\"samples\": [");
+            while (*p != ']') {
+                val = strtod(p, &end);
+                if (end == p)
+                    break;
+                add_sample(stats, val);
+                p = end;
+                while (*p == ',' || *p == ' ')
+                    p++;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+/*
+ * run_baseline - Run the baseline mdriver program once on a single
+ *     trace and add its result to the baseline stats for that trace
+ */
+static void run_baseline(char *prog, char *tracedir, char *tracefile,
+                         stats_t *base_stats)
+{
+    char tmpname[] = "/tmp/mdriver-baseline-XXXXXX";
+    char *path, *args[9];
+    int fd, status;
+    pid_t pid;
+
+    if ((fd = mkstemp(tmpname)) < 0)
+        unix_error("mkstemp failed in run_baseline");
+    close(fd);
+    if ((path = malloc(strlen(tracedir) + strlen(tracefile) + 1)) == NULL)
+        unix_error("malloc failed in run_baseline");
+    strcpy(path, tracedir);
+    strcat(path, tracefile);
+
+    /* Run it directly rather than through the shell, so no path needs quoting */
+    args[0] = prog;
+    args[1] = "-a";
+    args[2] = "-r";
+    args[3] = "1";
+    args[4] = "-f";
+    args[5] = path;
+    args[6] = "-j";
+    args[7] = tmpname;
+    args[8] = NULL;
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+        unix_error("fork failed in run_baseline");
+    if (pid == 0) {
+        if ((fd = open("/dev/null", O_WRONLY)) >= 0)
+            dup2(fd, STDOUT_FILENO);
+        execvp(prog, args);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        unlink(tmpname);
+        printf("Baseline command failed: %s -a -r 1 -f %s -j %s\n",
+               prog, path, tmpname);
+        exit(1);
+    }
+    read_baseline(tmpname, &tracefile, 1, base_stats);
+    unlink(tmpname);
+    free(path);
+}
+
+/*
+ * median - Median of n samples (sorts the array in place)
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *x, int n)
+{
+    qsort(x, n, sizeof(double), cmp_double);
+    return (n % 2) ? x[n/2] : (x[n/2-1] + x[n/2]) / 2;
+}
+
+/*
+ * mann_whitney - Two-sided p-value of the Mann-Whitney U test that
+ *     samples a and b come from the same distribution, using the normal
+ *     approximation with a continuity correction. Unlike a t-test, it
+ *     is not thrown off by the occasional very slow repetition.
+ */
+static double mann_whitney(double *a, int na, double *b, int nb)
+{
+    double u = 0, mu, sigma, z;
+    int i, j;
+
+    if (na < 2 || nb < 2)
+        return 1.0;
+    for (i = 0; i < na; i++)
+        for (j = 0; j < nb; j++)
+            u += (a[i] > b[j]) ? 1.0 : (a[i] == b[j]) ? 0.5 : 0.0;
+    mu = na * nb / 2.0;
+    sigma = sqrt(na * nb * (na + nb + 1) / 12.0);
+    z = (fabs(u - mu) - 0.5) / sigma;
+    if (z < 0)
+        z = 0;
+    return erfc(z / sqrt(2.0));
+}
+
+/*
+ * compare_results - Print the baseline and candidate results side by
+ *     side and return the number of traces that regressed. Throughput 
+ *     regresses if the candidate's repetitions are significantly slower
+ *     (Mann-Whitney p < SIG_LEVEL); utilization regresses if it dropped
+ *     by more than UTIL_TOLERANCE (it is deterministic, so any real drop
+ *     is significant).
+ */
+static int compare_results(int n, stats_t *base_stats, stats_t *mm_stats)
+{
+    int i, regressions = 0;
+    double bmed, cmed, p;
+    stats_t *b, *c;
+    char *verdict;
+
+    printf("%5s%8s%8s%10s%10s%8s%8s  %s\n", "trace", "util", "base", 
+           "Kops", "base", "change", "p", "verdict");
+    for (i = 0; i < n; i++) {
+        b = &base_stats[i];
+        c = &mm_stats[i];
+        if (!b->valid || b->nsamples == 0) {
+            printf("%2d%58s\n", i, "no baseline");
+            continue;
+        }
+        if (!c->valid) {
+            printf("%2d%58s\n", i, "REGRESSED (invalid)");
+            regressions++;
+            continue;
+        }
+
+        p = mann_whitney(c->samples, c->nsamples, b->samples, b->nsamples);
+        bmed = median(b->samples, b->nsamples);
+        cmed = median(c->samples, c->nsamples);
+        if (p < SIG_LEVEL && cmed > bmed)
+            verdict = (c->util < b->util - UTIL_TOLERANCE) ? 
+                "REGRESSED (thru, util)" : "REGRESSED (thru)";
+        else if (c->util < b->util - UTIL_TOLERANCE)
+            verdict = "REGRESSED (util)";
+        else if (p < SIG_LEVEL && cmed < bmed)
+            verdict = "faster";
+        else
+            verdict = "-";
+        if (verdict[0] == 'R')
+            regressions++;
+
+        printf("%2d%10.1f%%%7.1f%%%10.0f%10.0f%+7.1f%%%8.3f  %s\n", i,
+               c->util*100.0, b->util*100.0, 
+               (c->ops/1e3)/cmed, (b->ops/1e3)/bmed,
+               (bmed/cmed - 1.0)*100.0, p, verdict);
+    }
+    return regressions;
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+
+/*
+ * dump_events - Write the contents of mm's event ring, oldest event
+ *     first, to <dir>/<trace>.ev for the mmevents decoder
+ */
+static void dump_events(char *dir, char *tracefile)
+{
+    mm_event_file_t hdr;
+    mm_event_t *ring;
+    size_t capacity;
+    uint64_t count, i;
+    char path[2*MAXLINE];
+    FILE *fp;
+
+    if ((ring = mm_event_ring(&capacity, &count)) == NULL)
+        app_error("mm.c was built without MM_EVENTS; rebuild with make EVENTS=1");
+
+    sprintf(path, "%s/%s.ev", dir, basename_of(tracefile));
+    if ((fp = fopen(path, "wb")) == NULL) {
+        printf("Could not open %s in dump_events: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    hdr.magic = MM_EVENT_MAGIC;
+    hdr.record_size = sizeof(mm_event_t);
+    hdr.recorded = count;
+    hdr.dumped = (count < capacity) ? count : capacity;
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    for (i = count - hdr.dumped; i < count; i++)
+        fwrite(&ring[i & (capacity - 1)], sizeof(mm_event_t), 1, fp);
+    if (fclose(fp) != 0)
+        unix_error("fclose failed in dump_events");
+}
+
+/*
+ * printresults - prints a performance summary for some malloc package
+ */
+static void printresults(int n, stats_t *stats) 
+{
+    int i;
+    double secs = 0;
+    double ops = 0;
+    double util = 0;
+
+    /* Print the individual results for each trace */
+    printf("%5s%7s %5s%8s%10s%6s\n", 
+           "trace", " valid", "util", "ops", "secs", "Kops");
+    for (i=0; i < n; i++) {
+        if (stats[i].valid) {
+            printf("%2d%10s%5.0f%%%8.0f%10.6f%8.0f\n", 
+                   i,
+                   "yes",
+                   stats[i].util*100.0,
+                   stats[i].ops,
+                   stats[i].secs,
+                   (stats[i].ops/1e3)/stats[i].secs);
+            secs += stats[i].secs;
+            ops += stats[i].ops;
+            util += stats[i].util;
+        }
+        else {
+            printf("%2d%10s%6s%8s%10s%8s\n", 
+                   i,
+                   "no",
+                   "-",
+                   "-",
+                   "-",
+                   "-");
+        }
+    }
+
+    /* Print the aggregate results for the set of traces */
+    if (errors == 0) {
+        printf("%12s%5.0f%%%8.0f%10.6f%8.0f\n", 
+               "Total       ",
+               (util/n)*100.0,
+               ops, 
+               secs,
+               (ops/1e3)/secs);
+    }
+    else {
+        printf("%12s%6s%8s%10s%8s\n", 
+               "Total       ",
+               "-", 
+               "-", 
+               "-", 
+               "-");
+    }
+
+}
+
+/*
+ * weighted_util - Average utilization over the traces, each counted
+ *     as many times as its weight
+ */
+static double weighted_util(int n, stats_t *stats)
+{
+    double util = 0, weight = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        util += stats[i].weight * stats[i].util;
+        weight += stats[i].weight;
+    }
+    if (weight == 0)
+        app_error("Every trace has weight 0");
+    return util / weight;
+}
+
+/*
+ * weighted_thruput - Ops per second over the traces, each trace's ops
+ *     and secs counted as many times as its weight
+ */
+static double weighted_thruput(int n, stats_t *stats)
+{
+    double ops = 0, secs = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        ops += stats[i].weight * stats[i].ops;
+        secs += stats[i].weight * stats[i].secs;
+    }
+    if (secs == 0)
+        app_error("Every trace has weight 0");
+    return ops / secs;
+}
+
+/*
+ * thruput_key - Identify the trace set that a cached ceiling was 
+ *     measured with, by hashing the trace file names (FNV-1a)
+ */
+static unsigned long thruput_key(char **tracefiles, int n)
+{
+    unsigned long h = 2166136261UL;
+    char *p;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        for (p = basename_of(tracefiles[i]); *p; p++)
+            h = (h ^ (unsigned char)*p) * 16777619UL;
+        h = (h ^ '\n') * 16777619UL;
+    }
+    return h & 0xffffffffUL;
+}
+
+/*
+ * libc_thruput - The throughput of libc malloc on this host for these
+ *     traces, which caps the throughput term of the performance index. 
+ *     The results of -l are used when available. Otherwise the value is 
+ *     read from a per-host cache file, one "key Kops" line per trace set,
+ *     and measured and stored there if missing or if remeasure is set.
+ */
+static double libc_thruput(char **tracefiles, int n, stats_t *libc_stats,
+                           int remeasure)
+{
+    char dir[MAXLINE], path[2*MAXLINE], tmpname[2*MAXLINE + 8];
+    char host[256], line[MAXLINE];
+    unsigned long key = thruput_key(tracefiles, n), k;
+    double kops = 0, v;
+    stats_t *stats = libc_stats;
+    speed_t speed_params;
+    trace_t *trace;
+    FILE *fp, *out;
+    int i, len, fd, cached = cache_dir(dir, sizeof(dir));
+
+    if (gethostname(host, sizeof(host)) < 0)
+        strcpy(host, "localhost");
+    host[sizeof(host) - 1] = '\0';
+    len = snprintf(path, sizeof(path), "%s/%s.%s", dir, THRUPUT_CACHE, host);
+    if (len < 0 || (size_t)len >= sizeof(path))
+        cached = 0;
+
+    if (cached && stats == NULL && !remeasure && 
+        (fp = fopen(path, "r")) != NULL) {
+        while (fgets(line, sizeof(line), fp))
+            if (sscanf(line, "%lx %lf", &k, &v) == 2 && k == key)
+                kops = v;
+        fclose(fp);
+        if (kops > 0)
+            return kops * 1e3;
+    }
+
+    /* Time libc malloc on each trace */
+    if (stats == NULL) {
+        if (verbose)
+            printf("Measuring libc throughput on this host\n");
+        if ((stats = calloc(n, sizeof(stats_t))) == NULL)
+            unix_error("calloc failed in libc_thruput");
+        speed_params.alloc = &libc_alloc;
+        for (i = 0; i < n; i++) {
+            trace = read_trace(tracedir, tracefiles[i], verbose);
+            stats[i].ops = trace->num_ops;
+            stats[i].weight = trace->weight;
+            speed_params.trace = trace;
+            add_sample(&stats[i], fsecs(eval_libc_speed, &speed_params));
+            free_trace(trace);
+        }
+    }
+    kops = weighted_thruput(n, stats) / 1e3;
+    if (stats != libc_stats)
+        free(stats);
+    if (!cached || kops <= 0)
+        return kops * 1e3;
+
+    /* 
+     * Write the other trace sets' entries and this one to a new file
+     * that then replaces the cache, so that a run that is interrupted,
+     * or races with another, never leaves it half written
+     */
+    snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", path);
+    if ((fd = mkstemp(tmpname)) < 0)
+        return kops * 1e3;
+    if ((out = fdopen(fd, "w")) == NULL) {
+        close(fd);
+        unlink(tmpname);
+        return kops * 1e3;
+    }
+    if ((fp = fopen(path, "r")) != NULL) {
+        while (fgets(line, sizeof(line), fp))
+            if (sscanf(line, "%lx %lf", &k, &v) == 2 && k != key)
+                fprintf(out, "%lx %.0f\n", k, v);
+        fclose(fp);
+    }
+    fprintf(out, "%lx %.0f\n", key, kops);
+    if (fclose(out) != 0 || rename(tmpname, path) < 0)
+        unlink(tmpname);
+    return kops * 1e3;
+}
+
+/*
+ * printutil - prints the space utilization of mm next to that of the
+ *     system allocators. For libc, util comes from its arena footprint
+ *     and rss from its RSS growth; the other allocators only have rss.
+ */
+static void printutil(int n, stats_t *mm_stats, int nsys, 
+                      sysalloc_t *sysallocs, stats_t **sys_stats)
+{
+    int i, a, j;
+    double rss;
+
+    printf("Space utilization (peak live bytes / footprint):\n");
+    printf("%5s%8s", "trace", "mm");
+    for (a = 0; a < nsys; a++) {
+        if (sysallocs[a].is_libc)
+            printf("%10.10s", sysallocs[a].name);
+        printf("%10.6s/rss", sysallocs[a].name);
+    }
+    printf("\n");
+    for (i = 0; i < n; i++) {
+        printf("%2d", i);
+        if (mm_stats[i].valid)
+            printf("%10.0f%%", mm_stats[i].util*100.0);
+        else
+            printf("%11s", "-");
+        for (a = 0; a < nsys; a++) {
+            rss = 0;
+            for (j = 0; j < sys_stats[a][i].nmetrics; j++)
+                if (!strcmp(sys_stats[a][i].metrics[j].name, "util_rss"))
+                    rss = sys_stats[a][i].metrics[j].value;
+            if (sysallocs[a].is_libc && sys_stats[a][i].util > 0)
+                printf("%9.0f%%", sys_stats[a][i].util*100.0);
+            else if (sysallocs[a].is_libc)
+                printf("%10s", "-");
+            if (rss > 0)
+                printf("%13.0f%%", rss*100.0);
+            else
+                printf("%14s", "-");
+        }
+        printf("\n");
+    }
+}
+
+/*
+ * printoracle - prints the heap mm needed next to the heap the offline
+ *     oracle needed, and mm's utilization as a fraction of the oracle's
+ */
+static void printoracle(int n, stats_t *mm_stats)
+{
+    int i, j;
+    double heap, oheap, outil;
+
+    printf("Utilization against the offline oracle:\n");
+    printf("%5s%12s%12s%8s%8s%10s\n", 
+           "trace", "mm heap", "oracle heap", "util", "oracle", "of oracle");
+    for (i = 0; i < n; i++) {
+        printf("%2d", i);
+        if (!mm_stats[i].valid) {
+            printf("%13s\n", "-");
+            continue;
+        }
+        heap = oheap = outil = 0;
+        for (j = 0; j < mm_stats[i].nmetrics; j++) {
+            if (!strcmp(mm_stats[i].metrics[j].name, "heapsize"))
+                heap = mm_stats[i].metrics[j].value;
+            else if (!strcmp(mm_stats[i].metrics[j].name, "oracle_heap"))
+                oheap = mm_stats[i].metrics[j].value;
+            else if (!strcmp(mm_stats[i].metrics[j].name, "oracle_util"))
+                outil = mm_stats[i].metrics[j].value;
+        }
+        printf("%15.0f%12.0f%7.0f%%%7.0f%%%9.0f%%\n", heap, oheap,
+               mm_stats[i].util*100.0, outil*100.0, 
+               outil > 0 ? mm_stats[i].util / outil * 100.0 : 0.0);
+    }
+}
+
+/*****************
+ * The autotuner
+ ****************/
+
+#define MAXTUNE      256   /* most settings the autotuner tries */
+#define TUNE_ROUNDS  4     /* most rounds of local refinement */
+
+static char *param_names[MM_NPARAMS] = {"chunksize", "minsize", "split"};
+
+/* The starting grid for each parameter, ending with 0 */
+static size_t tune_grid[MM_NPARAMS][6] = {
+    {1024, 4096, 16384, 65536, 0},
+    {32, 64, 0},
+    {32, 64, 128, 256, 0},
+};
+
+/*
+ * tune_eval - Run every trace with mm's parameters set to p
+ */
+static void tune_eval(trace_t **traces, int n, int reps, tunepoint_t *p)
+{
+    stats_t *stats;
+    range_t *ranges = NULL;
+    speed_t speed_params;
+    int i, k, r;
+
+    p->valid = 1;
+    for (k = 0; k < MM_NPARAMS; k++)
+        if (mm_set_param(k, p->param[k]) < 0)
+            p->valid = 0;
+    if (!p->valid)
+        return;
+
+    if ((stats = (stats_t *)calloc(n, sizeof(stats_t))) == NULL)
+        unix_error("stats calloc in tune_eval failed");
+    for (i = 0; i < n && p->valid; i++) {
+        stats[i].ops = traces[i]->num_ops;
+        stats[i].weight = traces[i]->weight;
+        if (!eval_mm_valid(traces[i], i, &ranges, &stats[i].util)) {
+            p->valid = 0;
+            break;
+        }
+        speed_params.trace = traces[i];
+        speed_params.ranges = ranges;
+        for (r = 0; r < reps; r++)
+            add_sample(&stats[i], fsecs(eval_mm_speed, &speed_params));
+    }
+    if (p->valid) {
+        p->util = weighted_util(n, stats);
+        p->kops = weighted_thruput(n, stats) / 1e3;
+    }
+    clear_ranges(&ranges);
+    free(stats);
+}
+
+/*
+ * dominated - Does some other valid point have at least p's util and
+ *     Kops, and more of one of them?
+ */
+static int dominated(tunepoint_t *p, tunepoint_t *points, int npoints)
+{
+    int i;
+
+    for (i = 0; i < npoints; i++)
+        if (points[i].valid && 
+            points[i].util >= p->util && points[i].kops >= p->kops &&
+            (points[i].util > p->util || points[i].kops > p->kops))
+            return 1;
+    return 0;
+}
+
+/*
+ * tune_try - Evaluate a setting unless it has been tried already.
+ *     Returns 1 if it was new.
+ */
+static int tune_try(trace_t **traces, int n, int reps, size_t *param,
+                    tunepoint_t *points, int *npoints)
+{
+    int i, k;
+    tunepoint_t *p;
+
+    if (*npoints == MAXTUNE)
+        return 0;
+    for (i = 0; i < *npoints; i++)
+        if (!memcmp(points[i].param, param, sizeof(points[i].param)))
+            return 0;
+    p = &points[(*npoints)++];
+    memcpy(p->param, param, sizeof(p->param));
+    tune_eval(traces, n, reps, p);
+    if (verbose) {
+        for (k = 0; k < MM_NPARAMS; k++)
+            printf("%s=%lu ", param_names[k], (unsigned long)param[k]);
+        if (p->valid)
+            printf(": util %.1f%%, %.0f Kops\n", p->util*100.0, p->kops);
+        else
+            printf(": rejected\n");
+    }
+    return 1;
+}
+
+static int cmp_tunepoint(const void *a, const void *b)
+{
+    const tunepoint_t *x = a, *y = b;
+    if (x->util != y->util)
+        return (x->util < y->util) ? 1 : -1;
+    return (x->kops < y->kops) - (x->kops > y->kops);
+}
+
+/*
+ * autotune - Search mm's tunable parameters on the traces: every point
+ *     of a coarse grid, then, for a few rounds, the neighbors of each
+ *     point on the Pareto frontier of util against Kops (each parameter
+ *     a quarter up or down, in multiples of 16 bytes). Prints the
+ *     frontier and the settings behind each point on it.
+ */
+static void autotune(char **tracefiles, int n, int reps)
+{
+    trace_t **traces;
+    tunepoint_t *points, *front;
+    size_t param[MM_NPARAMS], step;
+    int npoints = 0, nfront, i, k, round, added;
+    int idx[MM_NPARAMS];
+
+    if ((traces = (trace_t **)malloc(n * sizeof(trace_t *))) == NULL ||
+        (points = (tunepoint_t *)calloc(MAXTUNE, sizeof(tunepoint_t))) == NULL ||
+        (front = (tunepoint_t *)calloc(MAXTUNE, sizeof(tunepoint_t))) == NULL)
+        unix_error("malloc in autotune failed");
+    for (i = 0; i < n; i++)
+        traces[i] = read_trace(tracedir, tracefiles[i], verbose);
+
+    /* The grid, in odometer order */
+    memset(idx, 0, sizeof(idx));
+    for (;;) {
+        for (k = 0; k < MM_NPARAMS; k++)
+            param[k] = tune_grid[k][idx[k]];
+        if (param[MM_PARAM_SPLIT_THRESHOLD] >= param[MM_PARAM_MINSIZE])
+            tune_try(traces, n, reps, param, points, &npoints);
+        for (k = 0; k < MM_NPARAMS; k++) {
+            if (tune_grid[k][++idx[k]] != 0)
+                break;
+            idx[k] = 0;
+        }
+        if (k == MM_NPARAMS)
+            break;
+    }
+
+    /* Refine around the frontier until it stops changing */
+    for (round = 0; round < TUNE_ROUNDS; round++) {
+        added = 0;
+        nfront = 0;
+        for (i = 0; i < npoints; i++)
+            if (points[i].valid && !dominated(&points[i], points, npoints))
+                front[nfront++] = points[i];
+        for (i = 0; i < nfront; i++) {
+            for (k = 0; k < MM_NPARAMS; k++) {
+                memcpy(param, front[i].param, sizeof(param));
+                step = ((front[i].param[k] / 4 + 15) / 16) * 16;
+                param[k] = front[i].param[k] + step;
+                added += tune_try(traces, n, reps, param, points, &npoints);
+                param[k] = front[i].param[k] - step;
+                added += tune_try(traces, n, reps, param, points, &npoints);
+            }
+        }
+        if (!added)
+            break;
+    }
+
+    /* Report the frontier, best util first */
+    nfront = 0;
+    for (i = 0; i < npoints; i++)
+        if (points[i].valid && !dominated(&points[i], points, npoints))
+            front[nfront++] = points[i];
+    qsort(front, nfront, sizeof(tunepoint_t), cmp_tunepoint);
+    printf("\nPareto frontier of util against throughput "
+           "(%d settings tried):\n", npoints);
+    for (k = 0; k < MM_NPARAMS; k++)
+        printf("%11s", param_names[k]);
+    printf("%8s%10s\n", "util", "Kops");
+    for (i = 0; i < nfront; i++) {
+        for (k = 0; k < MM_NPARAMS; k++)
+            printf("%11lu", (unsigned long)front[i].param[k]);
+        printf("%7.1f%%%10.0f\n", front[i].util*100.0, front[i].kops);
+    }
+    printf("Set these with mm_set_param or the MM_CHUNKSIZE, MM_MINSIZE "
+           "and\nMM_SPLIT_THRESHOLD environment variables.\n");
+
+    for (i = 0; i < n; i++)
+        free_trace(traces[i]);
+    free(traces);
+    free(points);
+    free(front);
+}
+
+/*********************************
+ * The allocator engine comparison
+ *********************************/
+
+/*
+ * run_engines - Evaluate mm and the engines loaded with -E on every
+ *     trace and print their results side by side. The timing
+ *     repetitions of the engines are interleaved, each repetition
+ *     starting with a different engine, so that they all see the same
+ *     machine conditions.
+ */
+static void run_engines(char **tracefiles, int n, int reps,
+                        mm_engine_t **engines, int nengines)
+{
+    stats_t *stats[MAXENGINES];
+    range_t *ranges = NULL;
+    speed_t speed_params;
+    trace_t *trace;
+    int i, e, k, r;
+
+    for (e = 0; e < nengines; e++)
+        if ((stats[e] = (stats_t *)calloc(n, sizeof(stats_t))) == NULL)
+            unix_error("stats calloc in run_engines failed");
+
+    for (i = 0; i < n; i++) {
+        trace = read_trace(tracedir, tracefiles[i], verbose);
+        for (e = 0; e < nengines; e++) {
+            stats[e][i].ops = trace->num_ops;
+            stats[e][i].weight = trace->weight;
+            if (verbose > 1)
+                printf("Checking %s for correctness and efficiency.\n",
+                       engines[e]->name);
+            stats[e][i].valid = eval_engine_valid(trace, i, engines[e], 
+                                                  &ranges);
+            if (stats[e][i].valid)
+                stats[e][i].util = eval_engine_util(trace, engines[e]);
+        }
+        speed_params.trace = trace;
+        for (r = 0; r < reps; r++) {
+            for (k = 0; k < nengines; k++) {
+                e = (r + k) % nengines;
+                if (!stats[e][i].valid)
+                    continue;
+                speed_params.engine = engines[e];
+                add_sample(&stats[e][i], 
+                           fsecs(eval_engine_speed, &speed_params));
+            }
+        }
+        free_trace(trace);
+    }
+    clear_ranges(&ranges);
+
+    /* One row per trace, util and Kops for each engine */
+    printf("\n%5s", "trace");
+    for (e = 0; e < nengines; e++)
+        printf("%16.16s", engines[e]->name);
+    printf("\n%5s", "");
+    for (e = 0; e < nengines; e++)
+        printf("%7s%9s", "util", "Kops");
+    printf("\n");
+    for (i = 0; i < n; i++) {
+        printf("%5d", i);
+        for (e = 0; e < nengines; e++) {
+            if (!stats[e][i].valid)
+                printf("%7s%9s", "-", "-");
+            else if (!engines[e]->heapsize)
+                printf("%7s%9.0f", "?", stats[e][i].ops/1e3/stats[e][i].secs);
+            else
+                printf("%6.0f%%%9.0f", stats[e][i].util*100.0,
+                       stats[e][i].ops/1e3/stats[e][i].secs);
+        }
+        printf("\n");
+    }
+
+    /* The weighted totals, and throughput relative to mm */
+    printf("%5s", "Total");
+    for (e = 0; e < nengines; e++) {
+        for (i = 0; i < n; i++)
+            if (!stats[e][i].valid)
+                break;
+        if (i < n)
+            printf("%7s%9s", "-", "-");
+        else if (!engines[e]->heapsize)
+            printf("%7s%9.0f", "?", weighted_thruput(n, stats[e])/1e3);
+        else
+            printf("%6.0f%%%9.0f", weighted_util(n, stats[e])*100.0,
+                   weighted_thruput(n, stats[e])/1e3);
+    }
+    printf("\n");
+    if (i == n) {
+        printf("%5s", "x mm");
+        for (e = 0; e < nengines; e++)
+            printf("%16.2f", weighted_thruput(n, stats[e]) / 
+                   weighted_thruput(n, stats[0]));
+        printf("\n");
+    }
+
+    for (e = 0; e < nengines; e++)
+        free(stats[e]);
+}
+
+/*******************************
+ * The multi-tenant replay (-M)
+ *******************************/
+
+/*
+ * tenant_cycles - Replay a mixed trace through mm, adding the cycles
+ *     each request takes to its tenant's total. Timing every request
+ *     slows the replay down, so this only splits the time of the
+ *     uninstrumented runs between the tenants.
+ */
+static void tenant_cycles(trace_t *trace, int *tenant, double *cycles)
+{
+    int i, index;
+    double t0, t1;
+    char *p;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in tenant_cycles");
+    start_counter();
+    t0 = get_counter();
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+        case ALLOC: /* mm_malloc */
+            if ((p = mm_malloc(trace->ops[i].size)) == NULL)
+                app_error("mm_malloc failed in tenant_cycles");
+            trace->blocks[index] = p;
+            break;
+        case REALLOC: /* mm_realloc */
+            if ((p = mm_realloc(trace->blocks[index], 
+                                trace->ops[i].size)) == NULL)
+                app_error("mm_realloc failed in tenant_cycles");
+            trace->blocks[index] = p;
+            break;
+        case FREE: /* mm_free */
+            mm_free(trace->blocks[index]);
+            break;
+        }
+        t1 = get_counter();
+        cycles[tenant[i]] += t1 - t0;
+        t0 = t1;
+    }
+}
+
+/*
+ * run_tenants - Replay the traces as tenants of one heap: their
+ *     requests interleaved by mix into one trace, with disjoint block
+ *     ids (see mix_traces). Prints utilization and throughput for the
+ *     mix, and for each tenant, its utilization and heap alone, its
+ *     part of the shared heap (in proportion to its live bytes at the
+ *     mix's peak), and its throughput in the mix.
+ */
+static void run_tenants(char **tracefiles, int n, int reps, int mix,
+                        double *weights)
+{
+    static char *mix_names[] = {"round-robin", "weighted", "by arrival"};
+    trace_t **traces, *trace;
+    stats_t *alone, mixed;
+    range_t *ranges = NULL;
+    speed_t speed_params;
+    int *tenant, i, t, r;
+    double *heap_alone, *live, *cycles;
+    double heap, total_cycles = 0, sum_heaps = 0, sum_live = 0;
+    double mixed_thruput;
+
+    if ((traces = (trace_t **)malloc(n * sizeof(trace_t *))) == NULL ||
+        (alone = (stats_t *)calloc(n, sizeof(stats_t))) == NULL ||
+        (heap_alone = (double *)calloc(n, sizeof(double))) == NULL ||
+        (live = (double *)calloc(n, sizeof(double))) == NULL ||
+        (cycles = (double *)calloc(n, sizeof(double))) == NULL)
+        unix_error("malloc in run_tenants failed");
+
+    /* Each tenant alone, on a fresh heap */
+    for (t = 0; t < n; t++) {
+        traces[t] = read_trace(tracedir, tracefiles[t], verbose);
+        alone[t].ops = traces[t]->num_ops;
+        alone[t].weight = 1;
+        if (!(alone[t].valid = eval_mm_valid(traces[t], t, &ranges,
+                                             &alone[t].util)))
+            continue;
+        heap_alone[t] = mem_heapsize();
+        sum_heaps += heap_alone[t];
+    }
+    if (errors)
+        return;
+
+    /* All of them together */
+    trace = mix_traces(traces, n, mix, weights, 1, &tenant);
+    memset(&mixed, 0, sizeof(mixed));
+    mixed.ops = trace->num_ops;
+    mixed.weight = 1;
+    if (!(mixed.valid = eval_mm_valid(trace, n, &ranges, &mixed.util))) {
+        printf("The mix failed. Its peak may not fit in MAX_HEAP (%d bytes).\n",
+               MAX_HEAP);
+        return;
+    }
+    heap = mem_heapsize();
+    speed_params.trace = trace;
+    speed_params.ranges = ranges;
+    for (r = 0; r < reps; r++)
+        add_sample(&mixed, fsecs(eval_mm_speed, &speed_params));
+    mixed_thruput = mixed.ops / mixed.secs;
+
+    /* Each tenant's live bytes at the mix's peak... */
+    for (i = 0; i <= trace->peak_op; i++) {
+        t = tenant[i];
+        switch (trace->ops[i].type) {
+        case ALLOC:
+            live[t] += trace->ops[i].size;
+            trace->block_sizes[trace->ops[i].index] = trace->ops[i].size;
+            break;
+        case REALLOC:
+            live[t] += trace->ops[i].size - 
+                (double)trace->block_sizes[trace->ops[i].index];
+            trace->block_sizes[trace->ops[i].index] = trace->ops[i].size;
+            break;
+        case FREE:
+            live[t] -= trace->block_sizes[trace->ops[i].index];
+            break;
+        }
+    }
+
+    /* ...and its share of the time */
+    tenant_cycles(trace, tenant, cycles);
+    for (t = 0; t < n; t++) {
+        total_cycles += cycles[t];
+        sum_live += live[t];
+    }
+
+    printf("\n%d tenants mixed %s, %.0f requests\n", n, mix_names[mix],
+           mixed.ops);
+    printf("%6s %-20s%9s%7s%11s%11s%9s\n", "tenant", "trace", "ops",
+           "alone", "alone KB", "shared KB", "Kops");
+    for (t = 0; t < n; t++)
+        printf("%6d %-20.20s%9.0f%6.0f%%%11.0f%11.0f%9.0f\n", t,
+               basename_of(tracefiles[t]), alone[t].ops, alone[t].util*100.0,
+               heap_alone[t]/1024, heap * live[t] / sum_live / 1024,
+               alone[t].ops / (mixed.secs * cycles[t] / total_cycles) / 1e3);
+    printf("Shared heap %.0f KB (%.0f%% of the separate heaps' %.0f KB), "
+           "util %.0f%%, %.0f Kops\n", heap/1024, 100.0 * heap / sum_heaps,
+           sum_heaps/1024, mixed.util*100.0, mixed_thruput/1e3);
+
+    clear_ranges(&ranges);
+    free(tenant);
+    free_trace(trace);
+    for (t = 0; t < n; t++)
+        free_trace(traces[t]);
+    free(traces);
+    free(alone);
+    free(heap_alone);
+    free(live);
+    free(cycles);
+}
+
+/*
+ * replay_checked - Run requests start to end-1 of the trace through mm,
+ *     checking each block and its data as eval_mm_valid does. The
+ *     blocks alive at start must be in ranges already.
+ */
+static int replay_checked(trace_t *trace, int tracenum, range_t **ranges,
+                          int start, int end)
+{
+    int i, j, index, size, oldsize;
+    char *p, *oldp;
+
+    for (i = start; i < end; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+        case ALLOC:
+            if ((p = mm_malloc(size)) == NULL) {
+                malloc_error(tracenum, i, "mm_malloc failed.");
+                return 0;
+            }
+            if (!add_range(ranges, p, size, tracenum, i, 
+                           mem_heap_lo(), mem_heap_hi()))
+                return 0;
+            memset(p, index & 0xFF, size);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case REALLOC:
+            oldp = trace->blocks[index];
+            if ((p = mm_realloc(oldp, size)) == NULL) {
+                malloc_error(tracenum, i, "mm_realloc failed.");
+                return 0;
+            }
+            remove_range(ranges, oldp);
+            if (!add_range(ranges, p, size, tracenum, i,
+                           mem_heap_lo(), mem_heap_hi()))
+                return 0;
+            oldsize = trace->block_sizes[index];
+            if (size < oldsize) oldsize = size;
+            for (j = 0; j < oldsize; j++)
+                if ((unsigned char)p[j] != (index & 0xFF)) {
+                    malloc_error(tracenum, i, "mm_realloc did not preserve "
+                                 "the data from old block");
+                    return 0;
+                }
+            memset(p, index & 0xFF, size);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case FREE:
+            p = trace->blocks[index];
+            remove_range(ranges, p);
+            mm_free(p);
+            break;
+
+        default:
+            app_error("Nonexistent request type in replay_checked");
+        }
+    }
+    return 1;
+}
+
+/*
+ * restart_trace - Replay the first half of the trace in a child process
+ *     on a new heap in the file path, which then exits without any
+ *     cleanup, as if it had crashed. Reopen the heap in this process,
+ *     at another address, check that mm_open accepts it and that the
+ *     live blocks kept their data, and replay the rest of the trace.
+ *     The child sends its heap address and the offset of each block.
+ */
+static int restart_trace(trace_t *trace, int tracenum, char *name,
+                         char *path)
+{
+    int half = trace->num_ops / 2;
+    int fds[2], status, i, j, index, live = 0, opened;
+    size_t *offsets, len, nbytes, done = 0;
+    char *old_lo, *lo, *p, *guard, *bytes;
+    range_t *ranges = NULL;
+    pid_t pid;
+    ssize_t n;
+
+    len = (trace->num_ids + 1) * sizeof(size_t);
+    if ((offsets = (size_t *)calloc(trace->num_ids + 1, 
+                                    sizeof(size_t))) == NULL)
+        unix_error("malloc in restart_trace failed");
+    if (unlink(path) < 0 && errno != ENOENT) {
+        sprintf(msg, "Could not remove %s", path);
+        unix_error(msg);
+    }
+    if (pipe(fds) < 0)
+        unix_error("pipe in restart_trace failed");
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+        unix_error("fork in restart_trace failed");
+
+    if (pid == 0) {
+        close(fds[0]);
+        if (mem_init_file(path) != 0 || mm_init() < 0) {
+            printf("Could not start a heap in %s\n", path);
+            _exit(1);
+        }
+        if (!replay_checked(trace, tracenum, &ranges, 0, half)) {
+            fflush(stdout);
+            _exit(1);
+        }
+        lo = mem_heap_lo();
+        offsets[0] = (size_t)lo;
+        for (i = 0; i < trace->num_ids; i++)
+            offsets[i+1] = trace->blocks[i] ? trace->blocks[i] - lo : 0;
+        for (bytes = (char *)offsets; done < len; done += n)
+            if ((n = write(fds[1], bytes + done, len - done)) <= 0)
+                _exit(1);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    for (bytes = (char *)offsets; done < len; done += n)
+        if ((n = read(fds[0], bytes + done, len - done)) <= 0)
+            break;
+    close(fds[0]);
+    if (waitpid(pid, &status, 0) < 0)
+        unix_error("waitpid in restart_trace failed");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || done < len) {
+        malloc_error(tracenum, 0, "the first half failed");
+        free(offsets);
+        return 0;
+    }
+    old_lo = (char *)offsets[0];
+
+    /* Keep the child's address taken, so that the heap moves */
+    nbytes = mem_pagesize() + MAX_HEAP;
+    guard = mmap(NULL, nbytes, PROT_NONE, 
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_init_file(path) != 1) {
+        malloc_error(tracenum, half, "the heap file could not be reopened");
+        free(offsets);
+        return 0;
+    }
+    if ((opened = mm_open()) < 0) {
+        malloc_error(tracenum, half, "mm_open rejected the heap");
+        mem_deinit();
+        free(offsets);
+        return 0;
+    }
+    lo = mem_heap_lo();
+
+    /* Which blocks are alive at the restart... */
+    for (i = 0; i < trace->num_ids; i++)
+        trace->blocks[i] = NULL;
+    for (i = 0; i < half; i++) {
+        index = trace->ops[i].index;
+        if (trace->ops[i].type == FREE)
+            trace->blocks[index] = NULL;
+        else {
+            trace->blocks[index] = lo + offsets[index+1];
+            trace->block_sizes[index] = trace->ops[i].size;
+        }
+    }
+
+    /* ...must still be where they were, and hold their data */
+    for (i = 0; i < trace->num_ids; i++) {
+        if ((p = trace->blocks[i]) == NULL)
+            continue;
+        live++;
+        if (!add_range(&ranges, p, trace->block_sizes[i], tracenum, half,
+                       mem_heap_lo(), mem_heap_hi()))
+            break;
+        for (j = 0; j < (int)trace->block_sizes[i]; j++)
+            if ((unsigned char)p[j] != (i & 0xFF)) {
+                malloc_error(tracenum, half, "a block lost its data "
+                             "across the restart");
+                break;
+            }
+        if (j < (int)trace->block_sizes[i])
+            break;
+    }
+    if (i == trace->num_ids)
+        replay_checked(trace, tracenum, &ranges, half, trace->num_ops);
+    if (errors == 0)
+        printf("%5d %-22.22s%9d%7d%10.0f  %s%s\n", tracenum, 
+               basename_of(name), half, live,
+               mem_heapsize() / 1024.0,
+               lo != old_lo ? "moved, " : "",
+               opened ? "free lists rebuilt" : "free lists ok");
+
+    clear_ranges(&ranges);
+    mem_deinit();
+    if (guard != MAP_FAILED)
+        munmap(guard, nbytes);
+    unlink(path);
+    free(offsets);
+    return errors == 0;
+}
+
+/*
+ * run_restarts - Test mm on a heap kept in the file path across a
+ *     restart halfway through each trace (see restart_trace)
+ */
+static void run_restarts(char **tracefiles, int n, char *path)
+{
+    trace_t *trace;
+    int i;
+
+    printf("\nRestarting halfway through each trace, heap in %s\n", path);
+    printf("%5s %-22s%9s%7s%10s  %s\n", "trace", "", "restart", "live",
+           "final KB", "reopened");
+    for (i = 0; i < n; i++) {
+        trace = read_trace(tracedir, tracefiles[i], verbose);
+        restart_trace(trace, i, tracefiles[i], path);
+        free_trace(trace);
+    }
+    if (errors == 0)
+        printf("All %d traces finished after the restart\n", n);
 }
 
 /* 
@@ -1005,13 +3403,46 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValFHORTU] [-L <lib>] [-f <file>] [-t <dir>] [-r <n>]\n"
+                    "               [-j <file>] [-c <file>] [-b <file> | -B <prog>]\n"
+                    "               [-p <file>] [-e <dir>] [-E <lib>]... [-M <mix>]\n"
+                    "               [-s <n>[%%] [-K <file>]] [-P <file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
-    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-b <file>  Compare with baseline results saved by -j.\n");
+    fprintf(stderr, "\t-B <prog>  Compare with baseline mdriver <prog>, run interleaved.\n");
+    fprintf(stderr, "\t-c <file>  Write per-trace results to <file> as CSV.\n");
+    fprintf(stderr, "\t-E <lib>   Compare mm with the allocator engine in shared library\n"
+                    "\t           <lib>, side by side (repeat for more engines).\n");
+    fprintf(stderr, "\t-e <dir>   Dump mm's event ring for each trace to <dir>\n"
+                    "\t           (needs a build with make EVENTS=1).\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as the trace file (repeat for more).\n");
+    fprintf(stderr, "\t-F         Break down the heap at peak by source of waste.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-K <file>  Keep the -s checkpoint's heap in <file> instead of memory.\n");
+    fprintf(stderr, "\t-j <file>  Write per-trace results to <file> as JSON.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-H         Start mm's heap at each trace's suggested heap size.\n");
+    fprintf(stderr, "\t-U         Take mm's utilization from the correctness pass,\n"
+                    "\t           skipping the separate utilization pass.\n");
+    fprintf(stderr, "\t-T         Search mm's tunable parameters for the "
+            "Pareto frontier\n\t           of util against throughput.\n");
+    fprintf(stderr, "\t-M <mix>   Replay the traces interleaved in one heap, as tenants:\n"
+                    "\t           rr, weighted or arrival, optionally followed by\n"
+                    "\t           :w1,w2,... (default: each trace's length).\n");
+    fprintf(stderr, "\t-O         Compare mm's utilization with an offline oracle's.\n");
+    fprintf(stderr, "\t-R         Remeasure libc's throughput on this host.\n");
+    fprintf(stderr, "\t-L <lib>   Run the malloc in shared library <lib> as well\n"
+                    "\t           (\"all\" loads every known allocator present).\n");
+    fprintf(stderr, "\t-P <file>  Test restarting mm halfway through each trace, with\n"
+                    "\t           its heap kept in <file>.\n");
+    fprintf(stderr, "\t-p <file>  Profile mm malloc on each trace, writing folded\n"
+                    "\t           stacks for flame graphs to <file>.\n");
+    fprintf(stderr, "\t-r <n>     Repeat each timing <n> times (default 1, or %d\n"
+                    "\t           when comparing).\n", COMPARE_REPS);
+    fprintf(stderr, "\t-s <n>     Time each trace from request <n> (or <n>%% of the way\n"
+                    "\t           through), restoring a checkpoint of mm's heap there.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
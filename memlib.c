@@ -10,14 +10,32 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* The header page of a heap file (see mem_init_file) */
+#define MEM_FILE_MAGIC 0x50414548424d454dULL  /* "MEMBHEAP" */
+typedef struct {
+    uint64_t magic;
+    uint64_t max_heap;            /* MAX_HEAP of the memlib that made it */
+    uint64_t brk;                 /* heap bytes in use */
+    char root[MEM_ROOT_SIZE];     /* see mem_root */
+} mem_file_t;
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_file_t *mem_file; /* header of the heap's file, if it has one */
+static size_t mem_map_len;   /* bytes of the file mapped */
+static union {               /* root area when there is no file */
+    char bytes[MEM_ROOT_SIZE];
+    uint64_t align;
+} mem_root_area;
 
 /* 
  * mem_init - initialize the memory system model
@@ -34,20 +52,79 @@ void mem_init(void)
     mem_brk = mem_start_brk;                  /* heap is empty initially */
 }
 
+/*
+ * mem_init_file - initialize the memory system model with the heap in
+ *    a mapped file, picking up the heap already in it, if any
+ */
+int mem_init_file(const char *path)
+{
+    size_t page = mem_pagesize();
+    struct stat st;
+    int fd, old;
+    void *p;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+	   return -1;
+    mem_map_len = page + MAX_HEAP;
+    if (fstat(fd, &st) < 0 ||
+	   (st.st_size != 0 && (size_t)st.st_size != mem_map_len) ||
+	   (st.st_size == 0 && ftruncate(fd, mem_map_len) < 0)) {
+	   close(fd);
+	   return -1;
+    }
+    old = (st.st_size != 0);
+    p = mmap(NULL, mem_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+	   return -1;
+
+    mem_file = (mem_file_t *)p;
+    if (old && (mem_file->magic != MEM_FILE_MAGIC ||
+		mem_file->max_heap != MAX_HEAP || mem_file->brk > MAX_HEAP)) {
+	   munmap(p, mem_map_len);
+	   mem_file = NULL;
+	   return -1;
+    }
+    if (!old) {
+	   mem_file->max_heap = MAX_HEAP;
+	   mem_file->brk = 0;
+	   mem_file->magic = MEM_FILE_MAGIC;
+    }
+    mem_start_brk = (char *)p + page;
+    mem_max_addr = mem_start_brk + MAX_HEAP;
+    mem_brk = mem_start_brk + mem_file->brk;
+    return old;
+}
+
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void)
 {
+    if (mem_file) {
+	   munmap(mem_file, mem_map_len);
+	   mem_file = NULL;
+	   return;
+    }
     free(mem_start_brk);
 }
 
+/*
+ * mem_root - return the allocator's root area (MEM_ROOT_SIZE bytes)
+ */
+void *mem_root(void)
+{
+    return mem_file ? (void *)mem_file->root : (void *)mem_root_area.bytes;
+}
+
 /*
  * mem_reset_brk - reset the simulated brk pointer to make an empty heap
  */
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    if (mem_file)
+	   mem_file->brk = 0;
 }
 
 /* 
@@ -65,9 +142,19 @@ void *mem_sbrk(int incr)
 	   return (void *)-1;
     }
     mem_brk += incr;
+    if (mem_file)
+	   mem_file->brk = mem_brk - mem_start_brk;
     return (void *)old_brk;
 }
 
+/*
+ * mem_heapavail - returns the number of bytes mem_sbrk can still provide
+ */
+size_t mem_heapavail(void)
+{
+    return (size_t)(mem_max_addr - mem_brk);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -99,3 +186,72 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_checkpoint - copy the used part of the heap into snap, in memory
+ *    or, if path is not NULL, in that file, mapped read-only
+ */
+int mem_checkpoint(mem_snapshot_t *snap, const char *path)
+{
+    size_t done = 0;
+    ssize_t n;
+    int fd;
+    void *p;
+
+    snap->base = mem_start_brk;
+    snap->size = (size_t)(mem_brk - mem_start_brk);
+    snap->map_len = 0;
+    if (path == NULL || snap->size == 0) {
+	   if ((snap->bytes = malloc(snap->size ? snap->size : 1)) == NULL) {
+	       fprintf(stderr, "mem_checkpoint: malloc error\n");
+	       exit(1);
+	   }
+	   memcpy(snap->bytes, mem_start_brk, snap->size);
+	   return 0;
+    }
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+	   return -1;
+    while (done < snap->size) {
+	   if ((n = write(fd, mem_start_brk + done, snap->size - done)) <= 0) {
+	       close(fd);
+	       return -1;
+	   }
+	   done += n;
+    }
+    p = mmap(NULL, snap->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+	   return -1;
+    snap->bytes = (char *)p;
+    snap->map_len = snap->size;
+    return 0;
+}
+
+/*
+ * mem_restore - copy a snapshot back into the heap and reset the brk
+ *    to where it was when the snapshot was taken
+ */
+void mem_restore(const mem_snapshot_t *snap)
+{
+    if (snap->base != mem_start_brk) {
+	   fprintf(stderr, "mem_restore: snapshot is of another heap\n");
+	   exit(1);
+    }
+    memcpy(mem_start_brk, snap->bytes, snap->size);
+    mem_brk = mem_start_brk + snap->size;
+    if (mem_file)
+	   mem_file->brk = snap->size;
+}
+
+/*
+ * mem_snapshot_free - free or unmap the copy held by a snapshot
+ */
+void mem_snapshot_free(mem_snapshot_t *snap)
+{
+    if (snap->map_len)
+	   munmap(snap->bytes, snap->map_len);
+    else
+	   free(snap->bytes);
+    snap->bytes = NULL;
+}
@@ -7,5 +7,43 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_heapavail(void);
 size_t mem_pagesize(void);
 
+/*
+ * Room for the allocator's own state, outside the heap so that it
+ * doesn't count toward the heap size, but kept with the heap when
+ * that is a file
+ */
+#define MEM_ROOT_SIZE 1024
+void *mem_root(void);
+
+/*
+ * Persistent heaps. mem_init_file is mem_init with the heap in the
+ * file path, mapped shared, so that it outlives the process. The file
+ * holds a header page with the brk and the root area, then the heap.
+ * Returns 1 if the file already held a heap, whose brk is restored
+ * (see mm_open), 0 if it was empty and now holds an empty heap, or -1
+ * if it can't be used. mem_deinit unmaps it.
+ */
+int mem_init_file(const char *path);
+
+
+/*
+ * Heap snapshots. mem_checkpoint copies the used part of the heap,
+ * into memory, or into the file path (which it then maps) if path is
+ * not NULL, and returns -1 if the file can't be written. mem_restore
+ * copies the snapshot back and moves the brk to where it was. A heap
+ * may hold pointers into itself, so a snapshot is only restored into
+ * the heap it was taken from.
+ */
+typedef struct {
+    char *base;      /* mem_heap_lo() when taken */
+    size_t size;     /* heap bytes copied */
+    char *bytes;     /* the copy */
+    size_t map_len;  /* bytes mapped from the file, or 0 if malloc'ed */
+} mem_snapshot_t;
+
+int mem_checkpoint(mem_snapshot_t *snap, const char *path);
+void mem_restore(const mem_snapshot_t *snap);
+void mem_snapshot_free(mem_snapshot_t *snap);
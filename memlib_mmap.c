@@ -0,0 +1,144 @@
+/*
+ * memlib_mmap.c - a version of memlib.c whose heap is real memory that
+ *            grows on demand, for running mm.c as a process's allocator
+ *            (see mmpreload.c).
+ *
+ * mm.c needs its heap to be contiguous, so mem_init reserves a large
+ * range of address space with mmap, without any access or backing
+ * store, and mem_sbrk makes it usable with mprotect a GROW_STEP at a
+ * time as the break moves up. Pages are only backed by memory once
+ * they are touched. Nothing here calls malloc.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+
+#include "memlib.h"
+
+#define RESERVE    (1UL << 36)   /* 64 GB of address space */
+#define GROW_STEP  (1UL << 20)   /* make the heap usable 1 MB at a time */
+
+/* private variables */
+static char *mem_start_brk;  /* points to first byte of heap */
+static char *mem_brk;        /* points to last byte of heap */
+static char *mem_max_addr;   /* largest legal heap address */
+static char *mem_usable;     /* end of the part made readable and writable */
+static union {               /* see mem_root */
+    char bytes[MEM_ROOT_SIZE];
+    unsigned long align;
+} mem_root_area;
+
+/*
+ * mem_init - reserve the address space for the heap
+ */
+void mem_init(void)
+{
+    void *p = mmap(NULL, RESERVE, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (p == MAP_FAILED) {
+	   fprintf(stderr, "mem_init: mmap error\n");
+	   exit(1);
+    }
+    mem_start_brk = mem_brk = mem_usable = (char *)p;
+    mem_max_addr = mem_start_brk + RESERVE;
+}
+
+/*
+ * mem_deinit - give the heap's address space back
+ */
+void mem_deinit(void)
+{
+    munmap(mem_start_brk, RESERVE);
+}
+
+/*
+ * mem_root - return the allocator's root area (MEM_ROOT_SIZE bytes)
+ */
+void *mem_root(void)
+{
+    return (void *)mem_root_area.bytes;
+}
+
+/*
+ * mem_reset_brk - reset the brk pointer to make an empty heap
+ */
+void mem_reset_brk()
+{
+    mem_brk = mem_start_brk;
+}
+
+/*
+ * mem_sbrk - Extends the heap by incr bytes and returns the start
+ *    address of the new area, making more of the reserved range usable
+ *    when needed. The heap cannot be shrunk. Failures only set errno,
+ *    since the caller may be the program's allocator.
+ */
+void *mem_sbrk(int incr)
+{
+    char *old_brk = mem_brk;
+    char *usable;
+
+    if ((incr < 0) || ((size_t)incr > (size_t)(mem_max_addr - mem_brk))) {
+	   errno = ENOMEM;
+	   return (void *)-1;
+    }
+    if (mem_brk + incr > mem_usable) {
+	   usable = mem_start_brk +
+	       ((mem_brk + incr - mem_start_brk + GROW_STEP - 1) / GROW_STEP) *
+	       GROW_STEP;
+	   if (usable > mem_max_addr)
+	       usable = mem_max_addr;
+	   if (mprotect(mem_usable, usable - mem_usable,
+			PROT_READ | PROT_WRITE) < 0) {
+	       errno = ENOMEM;
+	       return (void *)-1;
+	   }
+	   mem_usable = usable;
+    }
+    mem_brk += incr;
+    return (void *)old_brk;
+}
+
+/*
+ * mem_heapavail - returns the number of bytes mem_sbrk can still provide
+ */
+size_t mem_heapavail(void)
+{
+    return (size_t)(mem_max_addr - mem_brk);
+}
+
+/*
+ * mem_heap_lo - return address of the first heap byte
+ */
+void *mem_heap_lo()
+{
+    return (void *)mem_start_brk;
+}
+
+/*
+ * mem_heap_hi - return address of last heap byte
+ */
+void *mem_heap_hi()
+{
+    return (void *)(mem_brk - 1);
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes
+ */
+size_t mem_heapsize()
+{
+    return (size_t)(mem_brk - mem_start_brk);
+}
+
+/*
+ * mem_pagesize() - returns the page size of the system
+ */
+size_t mem_pagesize()
+{
+    return (size_t)getpagesize();
+}
@@ -0,0 +1,277 @@
+/*
+ * mkclasses.c - Generate the size class tables in sizeclasses.h from
+ *     the block sizes that traces request
+ *
+ *     unix> mkclasses -n 24 -o sizeclasses.h traces/amptjp-bal.rep ...
+ *
+ * Every malloc and realloc request is turned into the block size mm.c
+ * would carve for it, and the class boundaries are the ones that
+ * minimize the rounding waste of those blocks, had each been rounded up
+ * to the top of its class, using at most the given number of classes.
+ * The minimum is found exactly by dynamic programming over the block
+ * sizes up to the table's limit. Blocks above the limit all go in one
+ * last class. Fewer classes are used when more would not waste less.
+ *
+ * The header has the class tops, a table from block size to class (so
+ * finding a class is one index), and the slab geometry for each class:
+ * the fewest pages that hold its blocks with at most 1/SLAB_WASTE
+ * left over, and the number of blocks in them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define GRAIN       16       /* block sizes are multiples of this */
+#define MINBLOCK    32       /* mm.c's smallest block */
+#define OVERHEAD    16       /* mm.c's header and footer */
+#define PAGESIZE    4096
+#define SLAB_WASTE  8        /* slabs waste at most 1/8 */
+#define SLAB_MAXPAGES 16
+#define MAXCLASSES  64
+
+static void usage(void);
+
+/*
+ * slab_pages - The fewest pages that hold blocks of size bytes with at
+ *     most 1/SLAB_WASTE of them left over
+ */
+static size_t slab_pages(size_t size)
+{
+    size_t pages = 1;
+
+    while (pages < SLAB_MAXPAGES &&
+           (pages * PAGESIZE < size ||
+            (pages * PAGESIZE) % size > pages * PAGESIZE / SLAB_WASTE))
+        pages++;
+    return pages;
+}
+
+/* Same as mm_adjusted_size */
+static size_t adjusted_size(size_t size)
+{
+    if (size <= GRAIN)
+        return GRAIN + OVERHEAD;
+    return GRAIN * ((size + OVERHEAD + (GRAIN - 1)) / GRAIN);
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, j, k, m, n, t, best_m;
+    int budget = 24;
+    size_t maxsize = 8192, size;
+    char *outfile = NULL;
+    FILE *fp = stdout;
+    trace_t *trace;
+    double *count, *cum, *cumsize, cost, total = 0, large = 0;
+    double *dp, best_waste, requested = 0;
+    int *choice, *tops, ntops;
+
+    while ((c = getopt(argc, argv, "n:m:o:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Class budget, counting the class for large blocks */
+            budget = atoi(optarg);
+            if (budget < 2 || budget > MAXCLASSES) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'm': /* Largest block size in the lookup table */
+            maxsize = atol(optarg);
+            if (maxsize < MINBLOCK || maxsize % GRAIN != 0 ||
+                maxsize > (1 << 20)) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'o': /* Write the header here */
+            outfile = optarg;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    /*
+     * Count the blocks of each size. Size i is i * GRAIN bytes, and
+     * count[0] and count[1] stay 0 as no block is under MINBLOCK.
+     */
+    n = maxsize / GRAIN;
+    if ((count = calloc(n + 1, sizeof(double))) == NULL ||
+        (cum = calloc(n + 2, sizeof(double))) == NULL ||
+        (cumsize = calloc(n + 2, sizeof(double))) == NULL ||
+        (dp = malloc((size_t)budget * (n + 1) * sizeof(double))) == NULL ||
+        (choice = malloc((size_t)budget * (n + 1) * sizeof(int))) == NULL ||
+        (tops = malloc(budget * sizeof(int))) == NULL) {
+        printf("malloc failed in main\n");
+        exit(1);
+    }
+    for (t = optind; t < argc; t++) {
+        trace = read_trace("", argv[t], 0);
+        for (i = 0; i < trace->num_ops; i++) {
+            if (trace->ops[i].type == FREE || trace->ops[i].size == 0)
+                continue;
+            size = adjusted_size(trace->ops[i].size);
+            if (size > maxsize)
+                large++;
+            else {
+                count[size / GRAIN]++;
+                requested += size;
+            }
+            total++;
+        }
+        free_trace(trace);
+    }
+    for (i = 1; i <= n; i++) {
+        cum[i] = cum[i-1] + count[i];
+        cumsize[i] = cumsize[i-1] + count[i] * i * GRAIN;
+    }
+
+    /*
+     * dp[m][j] is the least waste of the sizes up to j in at most m
+     * classes, the top one ending at j, and choice[m][j] is where the
+     * class before it ends (-1 if m-1 classes do as well). The waste
+     * of a class from i to j is what rounding its blocks up to j costs.
+     * The top class ends at n so that every size in the table has one.
+     */
+#define WASTE(i, j) ((double)(j) * GRAIN * (cum[j] - cum[(i)-1]) - \
+                     (cumsize[j] - cumsize[(i)-1]))
+#define DP(m, j)     dp[(m) * (n + 1) + (j)]
+#define CHOICE(m, j) choice[(m) * (n + 1) + (j)]
+    for (j = 1; j <= n; j++)
+        DP(1, j) = WASTE(1, j);
+    best_m = 1;
+    for (m = 2; m < budget; m++) {
+        for (j = 1; j <= n; j++) {
+            DP(m, j) = DP(m - 1, j);
+            CHOICE(m, j) = -1;
+            for (i = 1; i < j; i++) {
+                cost = DP(m - 1, i) + WASTE(i + 1, j);
+                if (cost < DP(m, j)) {
+                    DP(m, j) = cost;
+                    CHOICE(m, j) = i;
+                }
+            }
+        }
+        if (DP(m, n) < DP(best_m, n))
+            best_m = m;
+    }
+    best_waste = DP(best_m, n);
+
+    /* Walk the choices back from the top class */
+    ntops = 0;
+    for (j = n, m = best_m; ; m--) {
+        while (m > 1 && CHOICE(m, j) < 0)
+            m--;
+        tops[ntops++] = j;
+        if (m == 1)
+            break;
+        j = CHOICE(m, j);
+    }
+    for (i = 0; i < ntops / 2; i++) {
+        k = tops[i];
+        tops[i] = tops[ntops - 1 - i];
+        tops[ntops - 1 - i] = k;
+    }
+
+    if (outfile && (fp = fopen(outfile, "w")) == NULL) {
+        printf("Could not open %s\n", outfile);
+        exit(1);
+    }
+    fprintf(fp, "/*\n * sizeclasses.h - Size classes for mm.c, "
+            "generated by mkclasses from\n *");
+    for (t = optind, k = 3; t < argc; t++) {
+        if (k + strlen(argv[t]) + 1 > 72) {
+            fprintf(fp, "\n *");
+            k = 3;
+        }
+        k += fprintf(fp, " %s", argv[t]);
+    }
+    fprintf(fp, "\n *\n * Don't edit; rerun \"make classes\". "
+            "Rounding the %.0f blocks of up to\n * %lu bytes to the tops "
+            "of their classes would waste %.1f%% of their\n * bytes; "
+            "%.0f larger blocks are in the last class.\n */\n",
+            total - large, (unsigned long)maxsize,
+            requested > 0 ? 100.0 * best_waste / requested : 0.0, large);
+    fprintf(fp, "#ifndef __SIZECLASSES_H_\n#define __SIZECLASSES_H_\n\n");
+    fprintf(fp, "#define SC_NCLASSES %d   /* the last is for blocks over "
+            "SC_MAXSIZE */\n", ntops + 1);
+    fprintf(fp, "#define SC_GRAIN    %d   /* block sizes are multiples of "
+            "this */\n", GRAIN);
+    fprintf(fp, "#define SC_MAXSIZE  %lu /* largest block size in sc_index "
+            "*/\n\n", (unsigned long)maxsize);
+
+    fprintf(fp, "/* Largest block size in each class (0: no limit) */\n");
+    fprintf(fp, "static const unsigned sc_size[SC_NCLASSES] = {");
+    for (i = 0; i < ntops; i++)
+        fprintf(fp, "%s%s%d", i ? "," : "", i % 8 ? " " : "\n    ",
+                tops[i] * GRAIN);
+    fprintf(fp, ", 0\n};\n\n");
+
+    fprintf(fp, "/* Pages per slab and blocks per slab, for each class */\n");
+    fprintf(fp, "static const unsigned sc_slab_pages[SC_NCLASSES] = {");
+    for (i = 0; i < ntops; i++)
+        fprintf(fp, "%s%s%lu", i ? "," : "", i % 8 ? " " : "\n    ",
+                (unsigned long)slab_pages(tops[i] * GRAIN));
+    fprintf(fp, ", 0\n};\n");
+    fprintf(fp, "static const unsigned sc_slab_blocks[SC_NCLASSES] = {");
+    for (i = 0; i < ntops; i++) {
+        size = tops[i] * GRAIN;
+        fprintf(fp, "%s%s%lu", i ? "," : "", i % 8 ? " " : "\n    ",
+                (unsigned long)(slab_pages(size) * PAGESIZE / size));
+    }
+    fprintf(fp, ", 0\n};\n\n");
+
+    fprintf(fp, "/* Class of each block size up to SC_MAXSIZE, by size / "
+            "SC_GRAIN */\n");
+    fprintf(fp, "static const unsigned char sc_index[SC_MAXSIZE / SC_GRAIN "
+            "+ 1] = {");
+    for (j = 0, k = 0; j <= n; j++) {
+        while (k < ntops - 1 && tops[k] < j)
+            k++;
+        fprintf(fp, "%s%s%d", j ? "," : "", j % 16 ? " " : "\n    ", k);
+    }
+    fprintf(fp, "\n};\n\n");
+    fprintf(fp, "#define SC_CLASS(size) ((size) <= SC_MAXSIZE ? "
+            "sc_index[(size) / SC_GRAIN] : \\\n"
+            "                        SC_NCLASSES - 1)\n\n");
+    fprintf(fp, "#endif /* __SIZECLASSES_H_ */\n");
+
+    if (outfile)
+        fclose(fp);
+    free(count);
+    free(cum);
+    free(cumsize);
+    free(dp);
+    free(choice);
+    free(tops);
+    exit(0);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mkclasses [-h] [-n <classes>] [-m <bytes>] "
+            "[-o <file>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-m <n>     Largest block size in the lookup table, "
+            "a multiple of %d\n\t           (default 8192).\n", GRAIN);
+    fprintf(stderr, "\t-n <n>     Most classes to use, counting the one for "
+            "larger blocks\n\t           (default 24, at most %d).\n",
+            MAXCLASSES);
+    fprintf(stderr, "\t-o <file>  Write the header to <file> instead of "
+            "stdout.\n");
+}
@@ -7,13 +7,20 @@ March 2020*/
  * a doubly linked list. Each block of memory contains a header
  * and a footer, which indicate the size of the block and
  * whether it is currently allocated. Free blocks are stored
- * in the explicit free doubly linked list. Each free block
- * contains a pointer to its predecessor and succesor so that
- * the list can be traversed easily. When blocks are freed,
- * they are merged with other free blocks next to them in
- * contiguous memory. When the heap runs out of space, we
- * extend its size and add the new space to the explicit
- * free list. */
+ * in explicit free doubly linked lists, one for each size
+ * class in sizeclasses.h (generated from the traces by
+ * mkclasses), so finding a block's list is a table lookup
+ * and a search starts at the list for the request's class.
+ * Each free block
+ * contains a link to its predecessor and succesor so that
+ * the list can be traversed easily. Links are offsets from the
+ * start of the heap, and the list heads live in memlib's root
+ * area rather than in globals, so that a heap kept in a mapped
+ * file works wherever it is mapped next time (see mm_open).
+ * When blocks are freed, they are merged with other free
+ * blocks next to them in contiguous memory. When the heap
+ * runs out of space, we extend its size and add the new
+ * space to the explicit free list. */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,6 +32,7 @@ March 2020*/
 
 #include "mm.h"
 #include "memlib.h"
+#include "sizeclasses.h"
 
 /*********************************************************
  * NOTE: Before you do anything else, please
@@ -46,9 +54,9 @@ team_t team = {
 /* Basic constants and macros */
 #define WSIZE       8       /* word size (bytes) */
 #define DSIZE       16      /* doubleword size (bytes) */
-#define CHUNKSIZE  (1<<12)  /* initial heap size (bytes) */
+#define CHUNKSIZE  (1<<12)  /* initial heap size (bytes), by default */
 #define OVERHEAD    16      /* overhead of header and footer (bytes) */
-#define MINSIZE     32      /* minimum block size (bytes) */
+#define MINSIZE     32      /* minimum block size (bytes), by default and at least */
 
 /* NOTE: feel free to replace these macros with helper functions and/or
  * add new ones that will be useful for you. Just make sure you think
@@ -80,9 +88,20 @@ team_t team = {
 #define NEXT_BLKP(bp)  (PADD(bp, GET_SIZE(HDRP(bp))))
 #define PREV_BLKP(bp)  (PSUB(bp, GET_SIZE((PSUB(bp, DSIZE)))))
 
-/* Get succesor and predecessor pointers of free block */
-#define GET_SUCC(bp)                 (*(char **)((bp) + WSIZE))
-#define GET_PRED(bp)                 (*(char **)(bp))
+/* Convert between pointers into the heap and offsets from its start,
+   with offset 0 (the alignment padding word) standing for NULL */
+#define TO_OFF(p)    ((p) == NULL ? 0 : (size_t)((char *)(p) - heap_base))
+#define TO_PTR(off)  ((off) == 0 ? NULL : heap_base + (off))
+
+/* Get and set the succesor and predecessor links of a free block */
+#define GET_SUCC(bp)        TO_PTR(*(size_t *)PADD(bp, WSIZE))
+#define GET_PRED(bp)        TO_PTR(*(size_t *)(bp))
+#define SET_SUCC(bp, p)     (*(size_t *)PADD(bp, WSIZE) = TO_OFF(p))
+#define SET_PRED(bp, p)     (*(size_t *)(bp) = TO_OFF(p))
+
+/* Get and set the head of the free list for class c */
+#define GET_HEAD(c)         TO_PTR(root->heads[c])
+#define SET_HEAD(c, p)      (root->heads[c] = TO_OFF(p))
 
 /* Function prototypes for internal helper routines */
 static bool check_heap(int lineno);
@@ -90,19 +109,67 @@ static void print_heap();
 static void print_block(void *bp);
 static bool check_block(int lineno, void *bp);
 static void *extend_heap(size_t size);
+static int init_heap(size_t initial_bytes);
 static void *find_fit(size_t asize);
 static void *coalesce(void *bp);
 static void place(void *bp, size_t asize);
+static void shrink_block(void *bp, size_t asize);
 static size_t max(size_t x, size_t y);
+static void load_env_params(void);
 static void insert_in_explicit_list(void *bp);
 static void remove_from_explicit_list(void *bp);
 static void print_free_list();
+static bool check_free_lists(size_t nfree);
+static void rebuild_free_lists(void);
+
+/*
+ * The allocator's state, kept in memlib's root area (mem_root) so that
+ * a heap in a mapped file carries it along. Offsets are from the
+ * start of the heap, and 0 means none.
+ */
+#define MM_MAGIC 0x48504d4dU   /* "MMPH" in little-endian order */
+typedef struct {
+    uint32_t magic;              /* MM_MAGIC once the heap is set up */
+    uint32_t nclasses;           /* SC_NCLASSES of the mm.c that set it up */
+    size_t heap_start;           /* the prologue block's payload */
+    size_t heads[SC_NCLASSES];   /* heads of the explicit free lists, one
+                                    per size class in sizeclasses.h */
+} mm_root_t;
+_Static_assert(sizeof(mm_root_t) <= MEM_ROOT_SIZE, "mm_root_t too big");
 
 /* Global variables */
 // Pointer to first block
 static void *heap_start = NULL;
-// Pointers to explicit free list head
-static void *head;
+// The root, and the address the offsets in the heap are from
+static mm_root_t *root;
+static char *heap_base;
+// Tunable parameters (see mm_set_param), and whether the environment
+// has been read for them yet
+static size_t params[MM_NPARAMS] = {CHUNKSIZE, MINSIZE, MINSIZE};
+static bool env_loaded = false;
+#define CHUNK       (params[MM_PARAM_CHUNKSIZE])
+#define MINBLOCK    (params[MM_PARAM_MINSIZE])
+#define SPLITMIN    (max(params[MM_PARAM_SPLIT_THRESHOLD], MINBLOCK))
+
+/* Event ring buffer (see mm.h). EVENT() compiles to nothing unless
+ * MM_EVENTS is defined, so the recording costs nothing when unused. */
+#ifdef MM_EVENTS
+#define EVENT_RING  (1<<16)  /* events kept; must be a power of 2 */
+static mm_event_t event_ring[EVENT_RING];
+static uint64_t event_count = 0;
+static char *event_base;     /* offsets are relative to this address */
+
+static inline void record_event(int type, int arg, size_t size, void *bp) {
+    mm_event_t *e = &event_ring[event_count++ & (EVENT_RING - 1)];
+    e->type = type;
+    e->arg = arg;
+    e->size = (uint32_t)size;
+    e->offset = bp ? (uint64_t)((char *)bp - event_base) : (uint64_t)-1;
+}
+#define EVENT(type, arg, size, bp) record_event(type, arg, size, bp)
+#else
+#define EVENT(type, arg, size, bp)
+#endif
 
 /*
  * mm_init -- this function initializes the heap by aligning
@@ -115,7 +182,47 @@ static void *head;
     list (which initially does not hold anything).
  */
 int mm_init(void) {
+    load_env_params();
+    return init_heap(CHUNK);
+}
+
+/*
+ * mm_init_hint -- like mm_init, but starts the heap with a single free
+                   block of about expected_bytes, so that a program
+                   that knows its peak usage avoids growing the heap
+                   one chunk at a time.
+ * Arguments: the expected peak heap size in bytes
+ * Returns -1 if it is unable to properly intialize the heap.
+ * The hint is rounded up to a whole chunk and capped at the space
+    memlib has left; a hint below one chunk behaves like mm_init.
+ */
+int mm_init_hint(size_t expected_bytes) {
+    size_t avail = mem_heapavail();
+    size_t size;
+
+    load_env_params();
+    size = ((expected_bytes + CHUNK - 1) / CHUNK) * CHUNK;
+
+    /* leave room for the prologue and epilogue */
+    avail = (avail > 4 * WSIZE) ? ((avail - 4 * WSIZE) / DSIZE) * DSIZE : 0;
+    if (size > avail)
+        size = avail;
+    if (size < CHUNK)
+        size = CHUNK;
+    return init_heap(size);
+}
+
+/*
+ * init_heap -- does the work of mm_init and mm_init_hint, extending
+                the new heap by initial_bytes
+ */
+static int init_heap(size_t initial_bytes) {
     void *bp;
+
+    root = mem_root();
+    root->magic = 0;
+    heap_base = mem_heap_lo();
+
     /* create the initial empty heap */
     if ((heap_start = mem_sbrk(4 * WSIZE)) == NULL)
         return (-1);
@@ -127,16 +234,80 @@ int mm_init(void) {
 
     heap_start = PADD(heap_start, DSIZE); /* start the heap at the (size 0) payload of the prologue block */
 
-    head = NULL;
+    root->nclasses = SC_NCLASSES;
+    root->heap_start = TO_OFF(heap_start);
+    memset(root->heads, 0, sizeof(root->heads));
+
+#ifdef MM_EVENTS
+    event_count = 0;
+    event_base = mem_heap_lo();
+#endif
 
-    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    bp = extend_heap(CHUNKSIZE / WSIZE);
+    /* Extend the empty heap with a single free block */
+    bp = extend_heap(initial_bytes / WSIZE);
     if (bp == NULL)
         return (-1);
 
+    root->magic = MM_MAGIC;
     return (0);
 }
 
+/*
+ * mm_open -- Picks up the heap already in memlib's heap, such as one
+              left in a mapped file (mem_init_file) by an earlier
+              process, instead of starting a new one.
+ * No arguments.
+ * Returns 0 if the heap is ready to use, 1 if it is too but its free
+   lists had to be rebuilt, and -1 if there is no heap or its blocks
+   are damaged.
+ * Every block must have matching boundary tags and lie within the
+   heap, ending with the epilogue at the brk. The free lists must hold
+   exactly the free blocks, each in its class's list with consistent
+   links. If only the lists are wrong, as when a process died halfway
+   through updating them, they are rebuilt from the blocks.
+ */
+int mm_open(void) {
+    char *lo = mem_heap_lo();
+    char *end = lo + mem_heapsize();
+    char *bp, *next;
+    size_t size, nfree = 0;
+
+    load_env_params();
+    root = mem_root();
+    heap_base = lo;
+    if (root->magic != MM_MAGIC || root->nclasses != SC_NCLASSES ||
+        root->heap_start != DSIZE || mem_heapsize() < 4 * WSIZE)
+        return (-1);
+    heap_start = lo + root->heap_start;
+    if (GET(HDRP(heap_start)) != PACK(DSIZE, 1) ||
+        GET(heap_start) != PACK(DSIZE, 1))
+        return (-1);
+
+    for (bp = NEXT_BLKP(heap_start); bp < end; bp = next) {
+        size = GET_SIZE(HDRP(bp));
+        if (size == 0)
+            break;
+        if (size % DSIZE || size < MINSIZE ||
+            size > (size_t)(end - bp) || GET(HDRP(bp)) != GET(FTRP(bp)))
+            return (-1);
+        if (!GET_ALLOC(HDRP(bp)))
+            nfree++;
+        next = NEXT_BLKP(bp);
+    }
+    if (bp != end || GET(HDRP(bp)) != PACK(0, 1))
+        return (-1);
+
+#ifdef MM_EVENTS
+    event_count = 0;
+    event_base = lo;
+#endif
+
+    if (check_free_lists(nfree))
+        return (0);
+    rebuild_free_lists();
+    return (1);
+}
+
 /*
  * mm_malloc -- Finds a chunk of memory in the heap and
                 returns a pointer to the start of the payload.
@@ -156,28 +327,46 @@ void *mm_malloc(size_t size) {
         return (NULL);
 
     /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE) {
-        asize = DSIZE + OVERHEAD;
-    } else {
-        /* Add overhead and then round up to nearest multiple of double-word alignment */
-        asize = DSIZE * ((size + (OVERHEAD) + (DSIZE - 1)) / DSIZE);
-    }
+    asize = mm_adjusted_size(size);
 
     /* Search the free list for a fit */
     if ((bp = find_fit(asize)) != NULL){
         place(bp, asize);
+        EVENT(MM_EV_MALLOC, 0, size, bp);
         return (bp);
     }
 
     /* No fit found. Get more memory and place the block */
-    extendsize = max(asize, CHUNKSIZE);
+    extendsize = max(asize, CHUNK);
     if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
         return (NULL);
 
     place(bp, asize);
+    EVENT(MM_EV_MALLOC, 0, size, bp);
     return (bp);
 }
 
+/*
+ * mm_adjusted_size -- Computes the block size mm_malloc carves out for
+                       a request, before any unsplit remainder is added.
+ * Arguments: the size of the requested payload
+ * Returns the payload plus header and footer, rounded up to a multiple
+   of the double-word alignment, and at least the minimum block size.
+ */
+size_t mm_adjusted_size(size_t size) {
+    if (size <= DSIZE)
+        return max(DSIZE + OVERHEAD, MINBLOCK);
+    /* Add overhead and then round up to nearest multiple of double-word alignment */
+    return max(DSIZE * ((size + (OVERHEAD) + (DSIZE - 1)) / DSIZE), MINBLOCK);
+}
+
+/*
+ * mm_block_overhead -- Returns the bytes of header and footer in a block
+ */
+size_t mm_block_overhead(void) {
+    return OVERHEAD;
+}
+
 /*
  * mm_free -- This function frees a previously allocated block,
               recreates correct boundary tags, coalesces with
@@ -196,21 +385,240 @@ void mm_free(void *bp) {
       return;
     }
 
+    EVENT(MM_EV_FREE, 0, GET_SIZE(HDRP(bp)), bp);
     PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), 0));
     PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), 0));
     coalesce(bp);
 }
 
 /*
- * EXTRA CREDIT
- * mm_realloc -- <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
-*/
+ * mm_realloc -- Changes the payload size of an allocated block, in
+                 place when possible. A shrinking block gives up its
+                 tail, and a growing block absorbs a free block after
+                 it or extends the heap when it is the last block.
+                 Otherwise the payload moves to a new block.
+ * Arguments: a pointer to an allocated block (or NULL) and the new
+   payload size
+ * Returns a pointer to the resized block, which holds the old payload
+   up to the smaller of the two sizes, or NULL if there is no memory
+   for it, in which case the old block is left as it was.
+ * A NULL ptr behaves like mm_malloc and a size of 0 like mm_free.
+ */
 void *mm_realloc(void *ptr, size_t size) {
-    // TODO: implement this function for EXTRA CREDIT
-    return (NULL);
+    size_t asize;      /* adjusted block size */
+    size_t currsize;   /* current block size */
+    size_t needed;     /* bytes to extend the heap by */
+    void *next;
+    void *newptr;
+
+    if (ptr == NULL)
+        return mm_malloc(size);
+    if (size == 0){
+        mm_free(ptr);
+        return (NULL);
+    }
+
+    asize = mm_adjusted_size(size);
+    currsize = GET_SIZE(HDRP(ptr));
+
+    /* The block is already big enough; return any large excess */
+    if (asize <= currsize){
+        shrink_block(ptr, asize);
+        return (ptr);
+    }
+
+    /* When the block ends the heap, or only a free block follows it,
+     * grow the heap just enough for the free space after it to fit. */
+    next = NEXT_BLKP(ptr);
+    if (GET_SIZE(HDRP(next)) == 0 ||
+        (!GET_ALLOC(HDRP(next)) && GET_SIZE(HDRP(NEXT_BLKP(next))) == 0)){
+        needed = asize - currsize - GET_SIZE(HDRP(next));
+        if (currsize + GET_SIZE(HDRP(next)) < asize &&
+            extend_heap(max(needed, MINBLOCK) / WSIZE) == NULL)
+            return (NULL);
+    }
+
+    /* Absorb a large enough free block that follows */
+    if (!GET_ALLOC(HDRP(next)) && currsize + GET_SIZE(HDRP(next)) >= asize){
+        currsize += GET_SIZE(HDRP(next));
+        remove_from_explicit_list(next);
+        PUT(HDRP(ptr), PACK(currsize, 1));
+        PUT(FTRP(ptr), PACK(currsize, 1));
+        shrink_block(ptr, asize);
+        return (ptr);
+    }
+
+    /* Move the payload to a new block */
+    if ((newptr = mm_malloc(size)) == NULL)
+        return (NULL);
+    memcpy(newptr, ptr, currsize - OVERHEAD);
+    mm_free(ptr);
+    return (newptr);
+}
+
+/*
+ * mm_usable_size -- Returns the number of payload bytes in an
+                     allocated block, which may exceed the size that
+                     was requested for it.
+ */
+size_t mm_usable_size(void *ptr) {
+    return GET_SIZE(HDRP(ptr)) - OVERHEAD;
+}
+
+
+/*
+ * mm_event_ring -- Gives access to the event ring buffer.
+ * Arguments: where to store the ring's capacity and the number of
+   events recorded since mm_init.
+ * Returns the ring, or NULL if mm.c was built without MM_EVENTS.
+ */
+mm_event_t *mm_event_ring(size_t *capacity, uint64_t *count) {
+#ifdef MM_EVENTS
+    *capacity = EVENT_RING;
+    *count = event_count;
+    return event_ring;
+#else
+    *capacity = 0;
+    *count = 0;
+    return NULL;
+#endif
+}
+
+/*
+ * mm_heap_walk -- Reports every block in the heap, in address order,
+                  not counting the prologue and epilogue.
+ * Arguments: the callback and a context pointer passed through to it.
+ * Returns the first nonzero callback result, or 0.
+ * A free block's free_class is its size class, SC_CLASS of its size,
+   if its predecessor on that class's list (or the list head, if it
+   has none) points back to it, and -1 otherwise, as for an allocated
+   block; so a block that was lost from its list shows up with -1.
+ */
+int mm_heap_walk(mm_walk_fn fn, void *ctx) {
+    mm_block_t block;
+    char *bp;
+    char *base = mem_heap_lo();
+    int result;
+
+    for (bp = NEXT_BLKP(heap_start); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        block.offset = bp - base;
+        block.size = GET_SIZE(HDRP(bp));
+        block.allocated = GET_ALLOC(HDRP(bp));
+        block.free_class = -1;
+        if (!block.allocated &&
+            (GET_PRED(bp) == NULL ? GET_HEAD(SC_CLASS(block.size)) == bp
+                                  : GET_SUCC(GET_PRED(bp)) == bp))
+            block.free_class = SC_CLASS(block.size);
+        if ((result = fn(&block, ctx)) != 0)
+            return result;
+    }
+    return 0;
+}
+
+/*
+ * mm_free_list_walk -- Reports every block on each free list, one size
+   class after another.
+ * Arguments: the callback and a context pointer passed through to it.
+ * Returns the first nonzero callback result, or 0.
+ */
+int mm_free_list_walk(mm_walk_fn fn, void *ctx) {
+    mm_block_t block;
+    char *bp;
+    char *base = mem_heap_lo();
+    int result, c;
+
+    for (c = 0; c < SC_NCLASSES; c++) {
+        for (bp = GET_HEAD(c); bp != NULL; bp = GET_SUCC(bp)) {
+            block.offset = bp - base;
+            block.size = GET_SIZE(HDRP(bp));
+            block.allocated = GET_ALLOC(HDRP(bp));
+            block.free_class = c;
+            if ((result = fn(&block, ctx)) != 0)
+                return result;
+        }
+    }
+    return 0;
+}
+
+/*
+ * mm_free_list_classes -- Returns the number of free lists (size classes)
+ */
+int mm_free_list_classes(void) {
+    return SC_NCLASSES;
+}
+
+/*
+ * mm_set_param -- Sets a tunable parameter (see mm.h). Changes take
+                   effect with the next request, and existing blocks
+                   are left as they are.
+ * Arguments: the MM_PARAM_ value and its new value
+ * Returns 0, or -1 if the value is out of range, leaving the
+   parameter unchanged.
+ * Block sizes must stay multiples of the double-word alignment and
+   big enough to hold the free list links, so the chunk size and the
+   minimum block size are multiples of DSIZE and at least MINSIZE.
+ */
+int mm_set_param(int param, size_t value) {
+    load_env_params();
+    switch (param){
+    case MM_PARAM_CHUNKSIZE:
+      if (value % DSIZE || value < MINSIZE || value > (1UL << 30))
+        return -1;
+      break;
+    case MM_PARAM_MINSIZE:
+      if (value % DSIZE || value < MINSIZE || value > (1UL << 20))
+        return -1;
+      break;
+    case MM_PARAM_SPLIT_THRESHOLD:
+      if (value < MINSIZE || value > (1UL << 30))
+        return -1;
+      break;
+    default:
+      return -1;
+    }
+    params[param] = value;
+    return 0;
+}
+
+/*
+ * mm_get_param -- Returns a tunable parameter's value, or 0 if param
+                   is not one
+ */
+size_t mm_get_param(int param) {
+    load_env_params();
+    if (param < 0 || param >= MM_NPARAMS)
+        return 0;
+    return params[param];
+}
+
+/*
+ * mm_state_size -- Returns the bytes mm_save_state needs
+ */
+size_t mm_state_size(void) {
+    return sizeof(mm_root_t);
+}
+
+/*
+ * mm_save_state -- Copies the allocator's state outside the heap (the
+                    start of the heap and the free list heads) to buf,
+                    so that with a copy of the heap (mem_checkpoint)
+                    the allocator can later be put back as it is now.
+ * Arguments: mm_state_size() bytes to copy the state to
+ */
+void mm_save_state(void *buf) {
+    memcpy(buf, root, sizeof(mm_root_t));
+}
+
+/*
+ * mm_restore_state -- Puts back the state mm_save_state copied. The
+                       heap must have been restored to the same point
+                       first (mem_restore).
+ */
+void mm_restore_state(const void *buf) {
+    root = mem_root();
+    memcpy(root, buf, sizeof(mm_root_t));
+    heap_base = mem_heap_lo();
+    heap_start = heap_base + root->heap_start;
 }
 
 
@@ -244,7 +652,8 @@ static void place(void *bp, size_t asize) {
      * occurs in these cases. Boundary tags are reset to indicate
      * that the block is allocated. The block is then removed
      * from the explicit free list. */
-    if (asize == currsize || newsize < MINSIZE){
+    if (asize == currsize || newsize < SPLITMIN){
+      EVENT(MM_EV_PLACE, 0, asize, bp);
       PUT(HDRP(bp), PACK(currsize, 1));
       PUT(FTRP(bp), PACK(currsize, 1));
       remove_from_explicit_list(bp);
@@ -257,9 +666,10 @@ static void place(void *bp, size_t asize) {
      * explicit free list, and the new free block is
      * coalesced with others around it. */
     else{
+      EVENT(MM_EV_PLACE, 1, asize, bp);
+      remove_from_explicit_list(bp); //before the size, and class, change
       PUT(HDRP(bp), PACK(asize, 1));
       PUT(FTRP(bp), PACK(asize, 1));
-      remove_from_explicit_list(bp);
       bp = NEXT_BLKP(bp);
       PUT(HDRP(bp), PACK(newsize, 0));
       PUT(FTRP(bp), PACK(newsize, 0));
@@ -268,6 +678,26 @@ static void place(void *bp, size_t asize) {
 
 }
 
+/*
+ * shrink_block -- Cut an allocated block down to asize bytes, if the
+                   rest is large enough to be a free block of its own.
+ * Takes a pointer to an allocated block and its new size.
+ * Returns nothing
+ * The freed tail is coalesced with the block after it.
+ */
+static void shrink_block(void *bp, size_t asize) {
+    size_t newsize = GET_SIZE(HDRP(bp)) - asize;
+
+    if (newsize < SPLITMIN)
+        return;
+    PUT(HDRP(bp), PACK(asize, 1));
+    PUT(FTRP(bp), PACK(asize, 1));
+    bp = NEXT_BLKP(bp);
+    PUT(HDRP(bp), PACK(newsize, 0));
+    PUT(FTRP(bp), PACK(newsize, 0));
+    coalesce(bp);
+}
+
 /*
  * coalesce -- Boundary tag coalescing.
  * Takes a pointer to a free block
@@ -317,28 +747,47 @@ static void *coalesce(void *bp) {
       PUT(FTRP(bp), PACK(newsize, 0));
     }
 
+    EVENT(MM_EV_COALESCE, (!prev_allocate << 1) | !next_allocate,
+          GET_SIZE(HDRP(bp)), bp);
     insert_in_explicit_list(bp); //add newly coalesced block to the explicit list
     return (bp); //return a pointer to the beginning of the block
 }
 
 
 /*
- * find_fit - Find a fit for a block with asize bytes using first fit.
+ * find_fit - Find a fit for a block with asize bytes using first fit,
+              starting with the list for asize's size class. Every
+              block in a higher class is large enough.
  * Arguments: the total size of requested block
  * Returns a pointer to the block of the correct size.
  * If no fit is found, returns null.
+ * The free block that ends the heap is only used when nothing else
+   fits, so that it stays free for the heap's last allocated block to
+   grow into with mm_realloc.
  */
 static void *find_fit(size_t asize) {
-    /* search from the start of the free list to the end */
-    void* cur_block = head;
-    while (cur_block != NULL){
-        if (asize <= (size_t)GET_SIZE(HDRP(cur_block))){
-          return cur_block; //return the first block large enough
+    void* cur_block;
+    void* last_fit = NULL; //the free block that ends the heap, if it fits
+    size_t steps = 0; //free blocks examined, for the event ring
+    int c;
+
+    for (c = SC_CLASS(asize); c < SC_NCLASSES; c++){
+        /* search from the start of the free list to the end */
+        for (cur_block = GET_HEAD(c); cur_block != NULL; cur_block = GET_SUCC(cur_block)){
+            steps++;
+            if (asize <= (size_t)GET_SIZE(HDRP(cur_block))){
+              if (GET_SIZE(HDRP(NEXT_BLKP(cur_block))) == 0){
+                last_fit = cur_block;
+                continue;
+              }
+              EVENT(MM_EV_FIT, 0, steps, cur_block);
+              return cur_block; //return the first block large enough
+            }
         }
-        cur_block = GET_SUCC(cur_block);
     }
 
-    return NULL;
+    EVENT(MM_EV_FIT, 0, steps, last_fit);
+    return last_fit;
 }
 
 /*
@@ -365,49 +814,52 @@ static void *extend_heap(size_t words) {
     PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
 
+    EVENT(MM_EV_EXTEND, 0, size, bp);
     return (coalesce(bp));
 }
 
-/* Inserts the free block pointer at the start the explicit free list
+/* Inserts the free block pointer at the start of the explicit free
+ * list for its size class
  * Arguments: Pointer the block to insert in list
  * Returns nothing
  * bp must be a pointer to a free block
 */
 static void insert_in_explicit_list(void *bp){
-  GET_SUCC(bp) = head;
-  if (head == NULL){ //list is empty
-    head = bp;
-  }
-  else{
-    GET_PRED(head) = bp;
+  int c = SC_CLASS(GET_SIZE(HDRP(bp)));
+  char *head = GET_HEAD(c);
+
+  SET_SUCC(bp, head);
+  if (head != NULL){ //list is not empty
+    SET_PRED(head, bp);
   }
-  GET_PRED(bp) = NULL;
-  head = bp;
+  SET_PRED(bp, NULL);
+  SET_HEAD(c, bp);
 }
 
-/* Removes the free block pointer in the explicit free list
+/* Removes the free block pointer in the explicit free list for its
+ * size class
  * Arguments: pointer to a block to be removed from List
  * Returns nothing
- * requires that block to be removed is in the list
+ * requires that block to be removed is in the list, and that its size
+ * has not changed since it was inserted
 */
 static void remove_from_explicit_list(void *bp){
-  void *pred = GET_PRED(bp);
-  void *succ = GET_SUCC(bp);
-  if((pred == NULL && succ == NULL) || pred == succ){ //only one element in list
-    if (head != NULL){
-      head = NULL;
-    }
+  int c = SC_CLASS(GET_SIZE(HDRP(bp)));
+  char *pred = GET_PRED(bp);
+  char *succ = GET_SUCC(bp);
+  if(pred == NULL && succ == NULL){ //only one element in list
+    SET_HEAD(c, NULL);
   }
   else if (pred != NULL && succ == NULL){ //element being removed is tail
-    GET_SUCC(pred) = NULL;
+    SET_SUCC(pred, NULL);
   }
   else if (pred == NULL && succ != NULL){ //element being removed is first element in list
-    GET_PRED(succ) = NULL;
-    head = succ;
+    SET_PRED(succ, NULL);
+    SET_HEAD(c, succ);
   }
   else if (pred != NULL && succ != NULL){ //when there is both a predecessor and succesor
-    GET_SUCC(pred) = succ;
-    GET_PRED(succ) = pred;
+    SET_SUCC(pred, succ);
+    SET_PRED(succ, pred);
   }
 }
 
@@ -491,17 +943,98 @@ static void print_block(void *bp) {
 }
 
 static void print_free_list(){
+  int c;
   printf("\nFree List: \n");
-  printf("head : %p\n", head);
-  void* cur_block = head;
-  int i = 1;
-  while (cur_block != NULL){
-      printf("%d element: %p -> ", i, cur_block);
-      cur_block = GET_SUCC(cur_block);
-      i++;
+  for (c = 0; c < SC_NCLASSES; c++){
+    printf("class %d head : %p\n", c, GET_HEAD(c));
+    void* cur_block = GET_HEAD(c);
+    int i = 1;
+    while (cur_block != NULL){
+        printf("%d element: %p -> ", i, cur_block);
+        cur_block = GET_SUCC(cur_block);
+        i++;
+    }
   }
 }
 
+/*
+ * check_free_lists -- Checks that the free lists hold exactly the
+                       nfree free blocks in the heap, for mm_open
+ * Each link must point to a free block of the list's class within
+   the heap, and each block's predecessor must be the block before it.
+ * Returns true if so. The walk stops after nfree blocks, so a list
+   with a cycle fails rather than running forever.
+ */
+static bool check_free_lists(size_t nfree) {
+    char *lo = mem_heap_lo();
+    char *end = lo + mem_heapsize();
+    char *bp, *prev;
+    size_t off, seen = 0;
+    int c;
+
+    for (c = 0; c < SC_NCLASSES; c++) {
+        prev = NULL;
+        for (off = root->heads[c]; off != 0; off = *(size_t *)PADD(bp, WSIZE)) {
+            bp = lo + off;
+            if (seen++ == nfree || off % DSIZE || bp <= (char *)heap_start ||
+                bp >= end || GET_ALLOC(HDRP(bp)) ||
+                SC_CLASS(GET_SIZE(HDRP(bp))) != c || GET_PRED(bp) != prev)
+                return false;
+            prev = bp;
+        }
+    }
+    return seen == nfree;
+}
+
+/*
+ * rebuild_free_lists -- Rebuilds the free lists from the blocks in the
+                         heap, merging any free blocks next to each
+                         other on the way, for mm_open
+ */
+static void rebuild_free_lists(void) {
+    char *bp, *next;
+    size_t size;
+
+    memset(root->heads, 0, sizeof(root->heads));
+    for (bp = NEXT_BLKP(heap_start); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp)))
+            continue;
+        size = GET_SIZE(HDRP(bp));
+        for (next = NEXT_BLKP(bp); GET_SIZE(HDRP(next)) > 0 &&
+                 !GET_ALLOC(HDRP(next)); next = NEXT_BLKP(next))
+            size += GET_SIZE(HDRP(next));
+        PUT(HDRP(bp), PACK(size, 0));
+        PUT(FTRP(bp), PACK(size, 0));
+        insert_in_explicit_list(bp);
+    }
+}
+
+/*
+ * load_env_params -- The first time it is called, sets each tunable
+                      parameter named in the environment (see mm.h).
+                      Values mm_set_param would reject are ignored,
+                      silently, since mm.c may be the program's malloc.
+ */
+static void load_env_params(void) {
+    static const char *names[MM_NPARAMS] = {
+        "MM_CHUNKSIZE", "MM_MINSIZE", "MM_SPLIT_THRESHOLD"
+    };
+    char *value, *end;
+    unsigned long v;
+    int i;
+
+    if (env_loaded)
+        return;
+    env_loaded = true;
+    for (i = 0; i < MM_NPARAMS; i++){
+        if ((value = getenv(names[i])) == NULL)
+            continue;
+        v = strtoul(value, &end, 0);
+        if (end != value && *end == '\0')
+            mm_set_param(i, v);
+    }
+}
+
 /*
  * max: returns x if x > y, and y otherwise.
  */
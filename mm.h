@@ -3,11 +3,112 @@ Carleton College
 March 2020*/
 
 #include <stdio.h>
+#include <stdint.h>
 
 extern int mm_init (void);
+extern int mm_init_hint(size_t expected_bytes);
+
+/* Picks up a heap left by an earlier process, such as one in a file
+   mapped by mem_init_file, after checking it: returns 0, or 1 if its
+   free lists had to be rebuilt, or -1 if it is missing or damaged */
+extern int mm_open(void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/* Block size used for a request of size bytes (before any unsplit
+   remainder), and the header/footer bytes included in every block */
+extern size_t mm_adjusted_size(size_t size);
+extern size_t mm_block_overhead(void);
+
+/*
+ * Tunable parameters. mm_set_param returns -1, leaving the parameter
+ * as it was, if the value is out of range. Before the first call to
+ * mm_init, mm_init_hint, mm_set_param or mm_get_param, each parameter
+ * is set from the environment variable named in its comment, if any.
+ */
+enum {
+    MM_PARAM_CHUNKSIZE,       /* MM_CHUNKSIZE: least bytes the heap grows
+                                 by (and its initial size), a multiple
+                                 of 16 (default 4096) */
+    MM_PARAM_MINSIZE,         /* MM_MINSIZE: smallest block, a multiple of
+                                 16, at least 32 (default 32) */
+    MM_PARAM_SPLIT_THRESHOLD, /* MM_SPLIT_THRESHOLD: a block is only split
+                                 if the rest is at least this big, and at
+                                 least the minimum block (default 32) */
+    MM_NPARAMS
+};
+
+extern int mm_set_param(int param, size_t value);
+extern size_t mm_get_param(int param);
+
+/*
+ * Checkpoints. mm_save_state copies the allocator's state outside the
+ * heap (its part of memlib's root area) into a buffer of
+ * mm_state_size() bytes; after mem_restore puts the heap back as it
+ * was, mm_restore_state puts the allocator back.
+ */
+extern size_t mm_state_size(void);
+extern void mm_save_state(void *buf);
+extern void mm_restore_state(const void *buf);
+
+/*
+ * Heap introspection. The walkers call fn once per block, in address
+ * order for mm_heap_walk and in list order for mm_free_list_walk, and
+ * stop early if fn returns nonzero (that value is then returned).
+ * Blocks are described by value, without formatting, so that analysis
+ * tools can consume heap state at memory speed.
+ */
+typedef struct {
+    size_t offset;      /* payload offset from mem_heap_lo() */
+    size_t size;        /* block size, including header and footer */
+    int allocated;      /* allocated bit from the header */
+    int free_class;     /* free list (size class) holding it, or -1 */
+} mm_block_t;
+
+typedef int (*mm_walk_fn)(const mm_block_t *block, void *ctx);
+
+extern int mm_heap_walk(mm_walk_fn fn, void *ctx);
+extern int mm_free_list_walk(mm_walk_fn fn, void *ctx);
+extern int mm_free_list_classes(void);
+
+/*
+ * Allocator event ring buffer. When mm.c is compiled with -DMM_EVENTS
+ * (make EVENTS=1), each allocator decision appends one record to a
+ * preallocated ring, overwriting the oldest records once it is full.
+ * Otherwise the recording compiles away and mm_event_ring returns NULL.
+ */
+enum {
+    MM_EV_MALLOC,   /* size = request, offset = payload returned */
+    MM_EV_FREE,     /* size = block size, offset = payload freed */
+    MM_EV_FIT,      /* size = free blocks searched, offset = fit or -1 */
+    MM_EV_PLACE,    /* arg = 1 if split, size = asize, offset = block */
+    MM_EV_COALESCE, /* arg = case (bit 1 prev free, bit 0 next free),
+                       size = merged size, offset = merged block */
+    MM_EV_EXTEND,   /* size = bytes added, offset = new free block */
+    MM_EV_NTYPES
+};
+
+typedef struct {
+    uint8_t type;     /* MM_EV_xxx */
+    uint8_t arg;      /* small per-type argument */
+    uint16_t pad;
+    uint32_t size;    /* per-type size or count */
+    uint64_t offset;  /* payload offset from the start of the heap */
+} mm_event_t;
+
+/* Event i (counting from mm_init) is ring[i & (*capacity - 1)] */
+extern mm_event_t *mm_event_ring(size_t *capacity, uint64_t *count);
+
+/* Event dump files: this header followed by the records, oldest first */
+#define MM_EVENT_MAGIC 0x56454d4dU   /* "MMEV" in little-endian order */
+typedef struct {
+    uint32_t magic;
+    uint32_t record_size;   /* sizeof(mm_event_t) */
+    uint64_t recorded;      /* events recorded, including overwritten ones */
+    uint64_t dumped;        /* records that follow */
+} mm_event_file_t;
 
 
 /*
@@ -0,0 +1,701 @@
+/*
+ * mmcapture.c - LD_PRELOAD shim that records a program's heap requests
+ *     as a trace that mdriver can replay
+ *
+ *     unix> make mmcapture.so
+ *     unix> LD_PRELOAD=./mmcapture.so MMCAPTURE_OUT=ls.%p.rep ls -l
+ *     unix> mdriver -f ls.12345.rep
+ *
+ * malloc, free, realloc, calloc, posix_memalign, memalign and
+ * aligned_alloc are forwarded to glibc through its __libc_* entry
+ * points, which avoids looking them up with dlsym (dlsym itself may
+ * call malloc). Each live pointer is mapped to a dense block id;
+ * freed ids are reused, so the trace needs no more ids than the
+ * program's peak number of live blocks.
+ *
+ * The map from pointers to ids is shared and protected by one lock,
+ * under which each request also gets a global sequence number. Each
+ * thread buffers its own records and appends them to an unlinked
+ * spool file a buffer at a time. At exit the
+ * spool is sorted back into request order and written as a .rep file,
+ * or in the binary format of tracefmt.h if MMCAPTURE_OUT ends in
+ * ".bin". A "%p" in MMCAPTURE_OUT is replaced by the process id; the
+ * default is mmcapture.%p.rep. A forked child starts a trace of its
+ * own and ignores frees of the blocks it inherited.
+ *
+ * Limitations: alignment requests are recorded as plain allocations,
+ * requests of 0 bytes as 1 byte (mdriver rejects empty blocks), and
+ * sizes are capped at INT_MAX. A process that leaves through exec or
+ * _exit writes no trace, and records appended by other threads while
+ * the process is exiting may be lost.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "tracefmt.h"
+
+#define BUFRECS     4096         /* records buffered per thread */
+#define MINSLOTS    (1 << 16)    /* initial pointer map size */
+#define MINIDS      (1 << 12)    /* initial id array sizes */
+#define OUTBUF      (1 << 16)    /* output file buffer */
+#define TLS         __attribute__((tls_model("initial-exec")))
+
+/* glibc's own allocator entry points */
+extern void *__libc_malloc(size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+/* One request, as spooled */
+typedef struct {
+    uint64_t seq;     /* global request order */
+    uint64_t size;
+    uint32_t id;
+    uint32_t type;    /* 'a', 'f' or 'r' */
+} crec_t;
+
+/* A thread's record buffer */
+typedef struct tbuf {
+    struct tbuf *next;       /* list of all buffers */
+    struct tbuf *next_idle;  /* list of buffers whose thread has exited */
+    int n;
+    crec_t recs[BUFRECS];
+} tbuf_t;
+
+/* A pointer map slot; key 0 marks an empty slot */
+typedef struct {
+    uintptr_t key;
+    uint32_t id;
+} slot_t;
+
+enum { UNINIT, ACTIVE, DONE };
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int state = UNINIT;
+static char out_path[PATH_MAX];
+static char spool_path[PATH_MAX + 8];
+static int spool_fd = -1;
+static pthread_key_t buf_key;
+
+/* Everything below is protected by lock */
+static uint64_t next_seq = 0;
+static slot_t *map = NULL;          /* pointer -> id, open addressing */
+static size_t map_slots = 0;
+static size_t map_used = 0;
+static uint32_t *free_ids = NULL;   /* stack of ids available for reuse */
+static size_t nfree = 0;
+static size_t free_cap = 0;
+static uint64_t *id_size = NULL;    /* size of the live block with each id */
+static size_t id_cap = 0;
+static uint32_t next_id = 0;        /* ids ever used; num_ids of the trace */
+static uint64_t live_bytes = 0;
+static uint64_t peak_bytes = 0;
+static tbuf_t *all_bufs = NULL;
+static tbuf_t *idle_bufs = NULL;
+
+static __thread tbuf_t *tbuf TLS = NULL;
+static __thread int in_hook TLS = 0;   /* bypass recording for our own use */
+
+/*****************************************
+ * Memory for the shim's own tables
+ *****************************************/
+
+static void *map_pages(size_t bytes)
+{
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+/*
+ * grow - Double an mmapped array of elem-byte elements, at least to
+ *     min elements. Returns 0 if out of memory.
+ */
+static int grow(void **array, size_t *cap, size_t min, size_t elem)
+{
+    size_t ncap = *cap ? *cap : min;
+    void *p;
+
+    while (ncap < min || ncap == *cap)
+        ncap *= 2;
+    if (*array == NULL)
+        p = map_pages(ncap * elem);
+    else
+        p = mremap(*array, *cap * elem, ncap * elem, MREMAP_MAYMOVE);
+    if (p == NULL || p == MAP_FAILED)
+        return 0;
+    *array = p;
+    *cap = ncap;
+    return 1;
+}
+
+/*****************************************
+ * The pointer map
+ *****************************************/
+
+static size_t slot_of(uintptr_t key)
+{
+    uint64_t h = (uint64_t)key * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(h ^ (h >> 29)) & (map_slots - 1);
+}
+
+static int map_insert(uintptr_t key, uint32_t id);
+
+/*
+ * map_grow - Double the map and reinsert its entries
+ */
+static int map_grow(void)
+{
+    slot_t *old = map;
+    size_t old_slots = map_slots, i;
+
+    map_slots = old_slots ? 2 * old_slots : MINSLOTS;
+    if ((map = map_pages(map_slots * sizeof(slot_t))) == NULL) {
+        map = old;
+        map_slots = old_slots;
+        return 0;
+    }
+    map_used = 0;
+    for (i = 0; i < old_slots; i++)
+        if (old[i].key)
+            map_insert(old[i].key, old[i].id);
+    if (old)
+        munmap(old, old_slots * sizeof(slot_t));
+    return 1;
+}
+
+static int map_insert(uintptr_t key, uint32_t id)
+{
+    size_t i;
+
+    if (2 * (map_used + 1) > map_slots && !map_grow())
+        return 0;
+    for (i = slot_of(key); map[i].key; i = (i + 1) & (map_slots - 1))
+        ;
+    map[i].key = key;
+    map[i].id = id;
+    map_used++;
+    return 1;
+}
+
+/*
+ * map_remove - Remove key, returning its id, or -1 if it isn't mapped.
+ *     Later entries of the probe run are shifted back into the hole.
+ */
+static int64_t map_remove(uintptr_t key)
+{
+    size_t i, j, home;
+    uint32_t id;
+
+    if (map_slots == 0)
+        return -1;
+    for (i = slot_of(key); map[i].key != key; i = (i + 1) & (map_slots - 1))
+        if (map[i].key == 0)
+            return -1;
+    id = map[i].id;
+    for (j = (i + 1) & (map_slots - 1); map[j].key;
+         j = (j + 1) & (map_slots - 1)) {
+        home = slot_of(map[j].key);
+        /* move j into the hole at i unless its home lies in (i, j] */
+        if ((j > i && (home <= i || home > j)) ||
+            (j < i && (home <= i && home > j))) {
+            map[i] = map[j];
+            i = j;
+        }
+    }
+    map[i].key = 0;
+    map_used--;
+    return id;
+}
+
+/*****************************************
+ * Recording
+ *****************************************/
+
+static void open_spool(void);
+
+/*
+ * init_capture - Work out the output file names and open the spool.
+ *     Called with lock held.
+ */
+static void init_capture(void)
+{
+    char *out = getenv("MMCAPTURE_OUT");
+    char *p, *q;
+    char pid[32];
+
+    if (out == NULL || *out == '\0')
+        out = "mmcapture.%p.rep";
+    snprintf(pid, sizeof(pid), "%d", (int)getpid());
+    for (p = out, q = out_path; *p && q < out_path + PATH_MAX - 32; p++) {
+        if (p[0] == '%' && p[1] == 'p') {
+            q += sprintf(q, "%s", pid);
+            p++;
+        }
+        else
+            *q++ = *p;
+    }
+    *q = '\0';
+    snprintf(spool_path, sizeof(spool_path), "%s.spool", out_path);
+    open_spool();
+}
+
+/*
+ * open_spool - Create the spool and unlink it at once, so that nothing
+ *     is left behind by a process that never gets to finish_capture
+ */
+static void open_spool(void)
+{
+    spool_fd = open(spool_path, O_CREAT | O_TRUNC | O_RDWR | O_APPEND | 
+                    O_CLOEXEC, 0644);
+    if (spool_fd >= 0)
+        unlink(spool_path);
+    state = (spool_fd < 0) ? DONE : ACTIVE;
+}
+
+/*
+ * flush_buf - Append a thread's buffered records to the spool
+ */
+static void flush_buf(tbuf_t *b)
+{
+    size_t len = b->n * sizeof(crec_t);
+    char *p = (char *)b->recs;
+    ssize_t n;
+
+    while (len > 0 && (n = write(spool_fd, p, len)) > 0) {
+        p += n;
+        len -= n;
+    }
+    b->n = 0;
+}
+
+/*
+ * release_buf - Thread exit: flush the thread's buffer and keep it for
+ *     reuse by a later thread
+ */
+static void release_buf(void *arg)
+{
+    tbuf_t *b = arg;
+
+    flush_buf(b);
+    pthread_mutex_lock(&lock);
+    b->next_idle = idle_bufs;
+    idle_bufs = b;
+    pthread_mutex_unlock(&lock);
+    tbuf = NULL;
+}
+
+/*
+ * get_buf - The calling thread's record buffer, or NULL
+ */
+static tbuf_t *get_buf(void)
+{
+    tbuf_t *b;
+
+    if (tbuf)
+        return tbuf;
+    pthread_mutex_lock(&lock);
+    if ((b = idle_bufs) != NULL)
+        idle_bufs = b->next_idle;
+    else if ((b = map_pages(sizeof(tbuf_t))) != NULL) {
+        b->next = all_bufs;
+        all_bufs = b;
+    }
+    pthread_mutex_unlock(&lock);
+    if (b) {
+        b->n = 0;
+        pthread_setspecific(buf_key, b);
+    }
+    return tbuf = b;
+}
+
+/*
+ * append - Add one record to the calling thread's buffer
+ */
+static void append(uint64_t seq, int type, uint32_t id, uint64_t size)
+{
+    tbuf_t *b = get_buf();
+    crec_t *r;
+
+    if (b == NULL)
+        return;
+    r = &b->recs[b->n++];
+    r->seq = seq;
+    r->type = type;
+    r->id = id;
+    r->size = size;
+    if (b->n == BUFRECS)
+        flush_buf(b);
+}
+
+/*
+ * tracing - Should the caller's request be recorded? Takes the lock
+ *     if so.
+ */
+static int tracing(void)
+{
+    if (in_hook)
+        return 0;
+    pthread_mutex_lock(&lock);
+    if (state == UNINIT)
+        init_capture();
+    if (state == ACTIVE)
+        return 1;
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+/*
+ * take_id - A free block id for size bytes. Called with lock held.
+ *     Returns -1 if out of memory.
+ */
+static int64_t take_id(uint64_t size)
+{
+    uint32_t id;
+
+    if (nfree > 0)
+        id = free_ids[--nfree];
+    else {
+        if (next_id == id_cap &&
+            !grow((void **)&id_size, &id_cap, MINIDS, sizeof(uint64_t)))
+            return -1;
+        id = next_id++;
+    }
+    id_size[id] = size;
+    live_bytes += size;
+    if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+    return id;
+}
+
+/*
+ * drop_id - Make id available again. Called with lock held.
+ */
+static void drop_id(uint32_t id)
+{
+    live_bytes -= id_size[id];
+    if (nfree == free_cap &&
+        !grow((void **)&free_ids, &free_cap, MINIDS, sizeof(uint32_t)))
+        return;   /* the id is never reused, which is still a valid trace */
+    free_ids[nfree++] = id;
+}
+
+/*
+ * record_alloc - p was just returned for a request of size bytes
+ */
+static void record_alloc(void *p, size_t size)
+{
+    int64_t id;
+    uint64_t seq;
+
+    if (p == NULL || !tracing())
+        return;
+    if (size == 0)
+        size = 1;
+    if ((id = take_id(size)) < 0 || !map_insert((uintptr_t)p, id)) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    seq = next_seq++;
+    pthread_mutex_unlock(&lock);
+    append(seq, 'a', id, size);
+}
+
+/*
+ * record_free - p is about to be freed. This must happen before the
+ *     real free, after which another thread could be given p.
+ */
+static void record_free(void *p)
+{
+    int64_t id;
+    uint64_t seq;
+
+    if (p == NULL || !tracing())
+        return;
+    if ((id = map_remove((uintptr_t)p)) < 0) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    drop_id(id);
+    seq = next_seq++;
+    pthread_mutex_unlock(&lock);
+    append(seq, 'f', id, 0);
+}
+
+/*****************************************
+ * The interposed functions
+ *****************************************/
+
+void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+
+    record_alloc(p, size);
+    return p;
+}
+
+void free(void *ptr)
+{
+    record_free(ptr);
+    __libc_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p = __libc_calloc(nmemb, size);
+
+    record_alloc(p, nmemb * size);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    int64_t id = -1;
+    uint64_t seq, old_size = 0;
+    void *p;
+
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+
+    /* Take ptr out of the map before the real realloc can free it */
+    if (tracing()) {
+        if ((id = map_remove((uintptr_t)ptr)) >= 0)
+            old_size = id_size[id];
+        pthread_mutex_unlock(&lock);
+    }
+    p = __libc_realloc(ptr, size);
+    if (id < 0) {
+        record_alloc(p, size);  /* a block we never saw allocated */
+        return p;
+    }
+
+    pthread_mutex_lock(&lock);
+    if (p == NULL || state != ACTIVE || !map_insert((uintptr_t)p, id)) {
+        /* on failure ptr is still live under its old id */
+        if (p == NULL && state == ACTIVE)
+            map_insert((uintptr_t)ptr, id);
+        pthread_mutex_unlock(&lock);
+        return p;
+    }
+    id_size[id] = size;
+    live_bytes += size - old_size;
+    if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+    seq = next_seq++;
+    pthread_mutex_unlock(&lock);
+    append(seq, 'r', id, size);
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)))
+        return EINVAL;
+    if ((p = __libc_memalign(alignment, size)) == NULL)
+        return ENOMEM;
+    record_alloc(p, size);
+    *memptr = p;
+    return 0;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *p = __libc_memalign(alignment, size);
+
+    record_alloc(p, size);
+    return p;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+/*****************************************
+ * Writing the trace
+ *****************************************/
+
+static char outbuf[OUTBUF];
+static size_t outlen = 0;
+static int out_fd = -1;
+
+static void out_flush(void)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < outlen && (n = write(out_fd, outbuf + done,
+                                       outlen - done)) > 0)
+        done += n;
+    outlen = 0;
+}
+
+static void out_bytes(const void *p, size_t len)
+{
+    if (outlen + len > OUTBUF)
+        out_flush();
+    memcpy(outbuf + outlen, p, len);
+    outlen += len;
+}
+
+static int cmp_seq(const void *a, const void *b)
+{
+    const crec_t *x = a, *y = b;
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static uint32_t clamp(uint64_t v)
+{
+    return (v > INT_MAX) ? INT_MAX : (uint32_t)v;
+}
+
+/*
+ * write_trace - Sort the spooled records and write the trace file
+ */
+static void write_trace(crec_t *recs, size_t n)
+{
+    size_t len = strlen(out_path), i;
+    int binary = (len > 4 && !strcmp(out_path + len - 4, ".bin"));
+    trace_bin_header_t hdr;
+    trace_bin_op_t op;
+    char line[64];
+
+    qsort(recs, n, sizeof(crec_t), cmp_seq);
+    if ((out_fd = open(out_path, O_CREAT | O_TRUNC | O_WRONLY, 0644)) < 0)
+        return;
+
+    if (binary) {
+        hdr.magic = TRACE_BIN_MAGIC;
+        hdr.record_size = sizeof(trace_bin_op_t);
+        hdr.sugg_heapsize = clamp(peak_bytes);
+        hdr.num_ids = next_id;
+        hdr.num_ops = n;
+        hdr.weight = 1;
+        out_bytes(&hdr, sizeof(hdr));
+        memset(&op, 0, sizeof(op));
+        for (i = 0; i < n; i++) {
+            op.type = recs[i].type;
+            op.index = recs[i].id;
+            op.size = clamp(recs[i].size);
+            out_bytes(&op, sizeof(op));
+        }
+    }
+    else {
+        len = snprintf(line, sizeof(line), "%u\n%u\n%lu\n1\n",
+                       clamp(peak_bytes), next_id, (unsigned long)n);
+        out_bytes(line, len);
+        for (i = 0; i < n; i++) {
+            if (recs[i].type == 'f')
+                len = snprintf(line, sizeof(line), "f %u\n", recs[i].id);
+            else
+                len = snprintf(line, sizeof(line), "%c %u %u\n",
+                               recs[i].type, recs[i].id,
+                               clamp(recs[i].size));
+            out_bytes(line, len);
+        }
+    }
+    out_flush();
+    close(out_fd);
+}
+
+/*
+ * finish_capture - Stop recording, then convert the spool to the trace
+ */
+static void finish_capture(void)
+{
+    tbuf_t *b;
+    off_t size;
+    void *recs;
+
+    pthread_mutex_lock(&lock);
+    if (state != ACTIVE) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    state = DONE;
+    pthread_mutex_unlock(&lock);
+
+    in_hook = 1;
+    for (b = all_bufs; b; b = b->next)
+        flush_buf(b);
+    size = lseek(spool_fd, 0, SEEK_END);
+    if (size > 0) {
+        recs = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    spool_fd, 0);
+        if (recs != MAP_FAILED) {
+            write_trace(recs, size / sizeof(crec_t));
+            munmap(recs, size);
+        }
+    }
+    else
+        write_trace(NULL, 0);
+    close(spool_fd);
+    in_hook = 0;
+}
+
+/*****************************************
+ * Process life cycle
+ *****************************************/
+
+static void before_fork(void)
+{
+    pthread_mutex_lock(&lock);
+}
+
+static void after_fork_parent(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * after_fork_child - Start a new trace for the child process. Other
+ *     threads don't exist in the child, so their buffers are dropped.
+ */
+static void after_fork_child(void)
+{
+    tbuf_t *b;
+
+    if (state == ACTIVE) {
+        close(spool_fd);
+        if (map)
+            memset(map, 0, map_slots * sizeof(slot_t));
+        map_used = nfree = 0;
+        next_id = 0;
+        next_seq = live_bytes = peak_bytes = 0;
+        for (b = all_bufs; b; b = b->next)
+            b->n = 0;
+        state = UNINIT;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+__attribute__((constructor))
+static void capture_init(void)
+{
+    pthread_key_create(&buf_key, release_buf);
+    pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+    if (tracing())
+        pthread_mutex_unlock(&lock);
+}
+
+__attribute__((destructor))
+static void capture_fini(void)
+{
+    finish_capture();
+}
@@ -0,0 +1,48 @@
+/*
+ * mmengine.c - Makes mm.c, or a variant of it, an allocator engine
+ *     for mdriver -E (see engine.h)
+ *
+ *     unix> cp mm.c mm-best.c; vi mm-best.c
+ *     unix> make engine-mm.so engine-mm-best.so
+ *     unix> mdriver -E ./engine-mm.so -E ./engine-mm-best.so
+ *
+ * Each engine library is linked with its own copy of memlib.c, and
+ * with -Bsymbolic so that its mm.c calls that copy rather than any
+ * other loaded one: every engine gets a heap of its own. ENGINE_NAME
+ * is the name of the variant, set by the Makefile.
+ */
+#include "engine.h"
+#include "mm.h"
+#include "memlib.h"
+
+#ifndef ENGINE_NAME
+#define ENGINE_NAME "mm"
+#endif
+
+/*
+ * engine_init - Set up the heap on first use, then empty it and
+ *     initialize the malloc package on it
+ */
+static int engine_init(void)
+{
+    static int heap_ready = 0;
+
+    if (!heap_ready) {
+        mem_init();
+        heap_ready = 1;
+    }
+    mem_reset_brk();
+    return mm_init();
+}
+
+mm_engine_t mm_engine = {
+    ENGINE_VERSION,
+    ENGINE_NAME,
+    engine_init,
+    mm_malloc,
+    mm_free,
+    mm_realloc,
+    mem_heapsize,
+    mem_heap_lo,
+    mem_heap_hi,
+};
@@ -0,0 +1,222 @@
+/*
+ * mmevents.c - Decode and summarize the event rings dumped by mdriver -e
+ *
+ * For each dump file, prints the number of events of each type, the
+ * distribution of free-list search lengths in find_fit, how often place
+ * split a block, which coalesce cases ran, and how much extend_heap
+ * added. With -d it also lists every event.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mm.h"
+
+#define MAXSTEPS  64   /* search lengths >= MAXSTEPS share one bucket */
+
+static char *type_names[MM_EV_NTYPES] = {
+    "malloc", "free", "fit", "place", "coalesce", "extend"
+};
+
+static char *coalesce_names[4] = {
+    "none free", "next free", "prev free", "both free"
+};
+
+/* Summary of one dump file */
+typedef struct {
+    unsigned long types[MM_EV_NTYPES];
+    unsigned long steps[MAXSTEPS + 1]; /* histogram of find_fit lengths */
+    unsigned long total_steps;
+    unsigned long max_steps;
+    unsigned long misses;              /* searches that found no fit */
+    unsigned long splits;
+    unsigned long coalesce[4];
+    unsigned long extend_bytes;
+    unsigned long max_offset;          /* highest payload offset returned */
+} summary_t;
+
+static void summarize(char *path, int dump);
+static void print_event(unsigned long i, mm_event_t *e);
+static void print_summary(summary_t *s);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int c;
+    int dump = 0;
+
+    while ((c = getopt(argc, argv, "dh")) != EOF) {
+        switch (c) {
+        case 'd': /* List every event */
+            dump = 1;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+    for (; optind < argc; optind++)
+        summarize(argv[optind], dump);
+    exit(0);
+}
+
+/*
+ * summarize - Read one dump file and print its summary
+ */
+static void summarize(char *path, int dump)
+{
+    FILE *fp;
+    mm_event_file_t hdr;
+    mm_event_t e;
+    summary_t s;
+    unsigned long i;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        printf("Could not open %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != MM_EVENT_MAGIC ||
+        hdr.record_size != sizeof(mm_event_t)) {
+        printf("%s is not an mm event dump\n", path);
+        exit(1);
+    }
+
+    printf("%s: %lu events recorded", path, (unsigned long)hdr.recorded);
+    if (hdr.dumped < hdr.recorded)
+        printf(", last %lu kept", (unsigned long)hdr.dumped);
+    printf("\n");
+
+    memset(&s, 0, sizeof(s));
+    for (i = 0; i < hdr.dumped; i++) {
+        if (fread(&e, sizeof(e), 1, fp) != 1) {
+            printf("%s: truncated after %lu events\n", path, i);
+            break;
+        }
+        if (e.type >= MM_EV_NTYPES) {
+            printf("%s: bad event type %d at record %lu\n", path, e.type, i);
+            exit(1);
+        }
+        if (dump)
+            print_event(hdr.recorded - hdr.dumped + i, &e);
+
+        s.types[e.type]++;
+        switch (e.type) {
+        case MM_EV_MALLOC:
+            if (e.offset > s.max_offset)
+                s.max_offset = e.offset;
+            break;
+        case MM_EV_FIT:
+            s.steps[e.size < MAXSTEPS ? e.size : MAXSTEPS]++;
+            s.total_steps += e.size;
+            if (e.size > s.max_steps)
+                s.max_steps = e.size;
+            if (e.offset == (uint64_t)-1)
+                s.misses++;
+            break;
+        case MM_EV_PLACE:
+            s.splits += e.arg;
+            break;
+        case MM_EV_COALESCE:
+            s.coalesce[e.arg & 3]++;
+            break;
+        case MM_EV_EXTEND:
+            s.extend_bytes += e.size;
+            break;
+        }
+    }
+    fclose(fp);
+    print_summary(&s);
+}
+
+/*
+ * print_event - Print one event on a line
+ */
+static void print_event(unsigned long i, mm_event_t *e)
+{
+    printf("%10lu %-9s", i, type_names[e->type]);
+    switch (e->type) {
+    case MM_EV_FIT:
+        printf("steps=%u ", e->size);
+        if (e->offset == (uint64_t)-1)
+            printf("no fit\n");
+        else
+            printf("offset=%lu\n", (unsigned long)e->offset);
+        break;
+    case MM_EV_PLACE:
+        printf("asize=%u offset=%lu %s\n", e->size,
+               (unsigned long)e->offset, e->arg ? "split" : "no split");
+        break;
+    case MM_EV_COALESCE:
+        printf("size=%u offset=%lu %s\n", e->size,
+               (unsigned long)e->offset, coalesce_names[e->arg & 3]);
+        break;
+    default:
+        printf("size=%u offset=%lu\n", e->size, (unsigned long)e->offset);
+    }
+}
+
+/*
+ * print_summary - Print the totals and the find_fit histogram
+ */
+static void print_summary(summary_t *s)
+{
+    unsigned long seen;
+    long p50 = -1, p90 = -1, p99 = -1;
+    unsigned long nfit = s->types[MM_EV_FIT];
+    int i;
+
+    for (i = 0; i < MM_EV_NTYPES; i++)
+        printf("  %-9s %10lu\n", type_names[i], s->types[i]);
+
+    if (nfit) {
+        for (i = 0, seen = 0; i <= MAXSTEPS; i++) {
+            seen += s->steps[i];
+            if (p50 < 0 && seen >= nfit * 0.50) p50 = i;
+            if (p90 < 0 && seen >= nfit * 0.90) p90 = i;
+            if (p99 < 0 && seen >= nfit * 0.99) p99 = i;
+        }
+        printf("  find_fit: mean %.1f steps, p50 %ld%s, p90 %ld%s, "
+               "p99 %ld%s, max %lu, %lu misses\n",
+               (double)s->total_steps / nfit,
+               p50, p50 == MAXSTEPS ? "+" : "",
+               p90, p90 == MAXSTEPS ? "+" : "",
+               p99, p99 == MAXSTEPS ? "+" : "",
+               s->max_steps, s->misses);
+    }
+    if (s->types[MM_EV_PLACE])
+        printf("  place: %lu split (%.1f%%), %lu whole\n", s->splits,
+               100.0 * s->splits / s->types[MM_EV_PLACE],
+               s->types[MM_EV_PLACE] - s->splits);
+    if (s->types[MM_EV_COALESCE]) {
+        printf("  coalesce:");
+        for (i = 0; i < 4; i++)
+            printf(" %s %lu%s", coalesce_names[i], s->coalesce[i],
+                   i < 3 ? "," : "\n");
+    }
+    if (s->types[MM_EV_EXTEND])
+        printf("  extend_heap: %lu bytes in %lu calls\n",
+               s->extend_bytes, s->types[MM_EV_EXTEND]);
+    if (s->types[MM_EV_MALLOC])
+        printf("  highest payload offset: %lu\n", s->max_offset);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmevents [-dh] <dump.ev>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-d         List every event.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
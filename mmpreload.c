@@ -0,0 +1,240 @@
+/*
+ * mmpreload.c - LD_PRELOAD shim that makes mm.c the allocator of any
+ *     dynamically linked program
+ *
+ *     unix> make mmpreload.so
+ *     unix> time LD_PRELOAD=./mmpreload.so gzip -9 < file > /dev/null
+ *
+ * The standard malloc API is implemented with mm_malloc, mm_free and
+ * mm_realloc, on a heap from memlib_mmap.c. mm.c is not thread safe,
+ * so one lock serializes every call into it.
+ *
+ * The first allocation can come from the dynamic linker or from
+ * another library's constructor before ours has run, so the heap is
+ * set up by whichever call comes first. Nothing on that path calls
+ * malloc. The few requests that mm.c can't serve are passed to glibc
+ * through its __libc_* entry points rather than through dlsym, which
+ * may itself call malloc: alignments above 16 bytes, and requests too
+ * large for mem_sbrk's int argument. free and realloc tell the two
+ * kinds of block apart by whether they lie in mm's heap.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define MM_ALIGNMENT    16           /* alignment of mm_malloc's blocks */
+#define MM_MAX_REQUEST  (1UL << 30)  /* larger requests go to glibc */
+
+/* glibc's own allocator entry points */
+extern void *__libc_malloc(size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int initialized = 0;      /* mm_init succeeded; see in_mm_heap */
+static int failed = 0;           /* mm_init failed; use glibc for everything */
+
+/*
+ * lock_mm - Take the lock, setting up the heap on the first call.
+ *     Returns 0 (without the lock) if mm is not usable.
+ */
+static int lock_mm(void)
+{
+    pthread_mutex_lock(&lock);
+    if (!initialized && !failed) {
+        mem_init();
+        if (mm_init() < 0)
+            failed = 1;
+        else
+            __atomic_store_n(&initialized, 1, __ATOMIC_RELEASE);
+    }
+    if (failed) {
+        pthread_mutex_unlock(&lock);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * in_mm_heap - Was ptr allocated by mm? The heap only grows, so its
+ *     bounds can be read without the lock, once initialized says that
+ *     mm_init has set them up: the acquire pairs with the release that
+ *     publishes it in lock_mm.
+ */
+static int in_mm_heap(void *ptr)
+{
+    return __atomic_load_n(&initialized, __ATOMIC_ACQUIRE) &&
+        (char *)ptr >= (char *)mem_heap_lo() &&
+        (char *)ptr <= (char *)mem_heap_hi();
+}
+
+/*
+ * allocate - malloc itself. calloc must not call malloc directly: gcc
+ *     turns malloc followed by memset into a call to calloc.
+ */
+static void *allocate(size_t size)
+{
+    void *p;
+
+    if (size >= MM_MAX_REQUEST || !lock_mm())
+        return __libc_malloc(size);
+    p = mm_malloc(size ? size : 1);
+    pthread_mutex_unlock(&lock);
+    if (p == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+void *malloc(size_t size)
+{
+    return allocate(size);
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    if (!in_mm_heap(ptr)) {
+        __libc_free(ptr);
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    mm_free(ptr);
+    pthread_mutex_unlock(&lock);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    size_t bytes;
+    void *p;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if ((p = allocate(bytes)) != NULL)
+        memset(p, 0, bytes);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    size_t old;
+    void *p;
+
+    if (ptr == NULL)
+        return allocate(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    if (!in_mm_heap(ptr))
+        return __libc_realloc(ptr, size);
+
+    if (size < MM_MAX_REQUEST) {
+        pthread_mutex_lock(&lock);
+        p = mm_realloc(ptr, size);
+        pthread_mutex_unlock(&lock);
+        if (p == NULL)
+            errno = ENOMEM;
+        return p;
+    }
+
+    /* Too large for mm: move the block to glibc */
+    if ((p = __libc_malloc(size)) == NULL)
+        return NULL;
+    pthread_mutex_lock(&lock);
+    old = mm_usable_size(ptr);
+    memcpy(p, ptr, old);
+    mm_free(ptr);
+    pthread_mutex_unlock(&lock);
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    if (alignment <= MM_ALIGNMENT)
+        return allocate(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)))
+        return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(getpagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = getpagesize();
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    static size_t (*libc_usable_size)(void *) = NULL;
+    size_t size;
+
+    if (ptr == NULL)
+        return 0;
+    if (in_mm_heap(ptr)) {
+        pthread_mutex_lock(&lock);
+        size = mm_usable_size(ptr);
+        pthread_mutex_unlock(&lock);
+        return size;
+    }
+
+    /* Only blocks from glibc get here, and by then malloc works, so
+       dlsym can allocate */
+    if (libc_usable_size == NULL)
+        libc_usable_size = (size_t (*)(void *))
+            dlsym(RTLD_NEXT, "malloc_usable_size");
+    return libc_usable_size ? libc_usable_size(ptr) : 0;
+}
+
+/*
+ * A child forked while another thread held the lock would deadlock on
+ * it, so hold it across fork
+ */
+static void before_fork(void)
+{
+    pthread_mutex_lock(&lock);
+}
+
+static void after_fork(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+__attribute__((constructor))
+static void preload_init(void)
+{
+    pthread_atfork(before_fork, after_fork, after_fork);
+}
@@ -0,0 +1,496 @@
+/*
+ * mmscale.c - Make larger or smaller versions of a malloc trace
+ *
+ *     unix> mmscale -n 100 -o big.rep traces/binary2-bal.rep
+ *     unix> mmscale -d 0.01 -o small.bin huge.bin
+ *
+ * Amplifying (-n) interleaves copies of the trace, each with block ids
+ * of its own. Copy k starts k shifts after the first, a shift (-s)
+ * being a fraction of the trace's length, so the copies' peaks don't
+ * all line up; their request sizes can also be scaled (-S).
+ *
+ * Downsampling (-d) keeps every request of a random fraction of the
+ * block ids and drops the rest. Each block that is kept has its whole
+ * history, and the distributions of sizes and of lifetimes (measured
+ * as a fraction of the trace) stay what they were.
+ *
+ * Either way, the input and output are summarized with the same
+ * metrics, and each output metric is checked against the value that
+ * the input predicts for it. The size and lifetime distributions are
+ * compared by how much of one histogram would have to move to match the
+ * other. The lifetimes and peak live bytes of an amplified trace are
+ * predicted by laying the input's copies out as amplify does. mmscale
+ * exits with status 2 if a metric is off by more than the tolerance
+ * (-t).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "trace.h"
+
+#define NOCTAVES   32     /* power-of-two histogram buckets */
+
+/* Summary metrics of a trace */
+typedef struct {
+    double ops, allocs, reallocs, frees;
+    double bytes;                 /* bytes requested by malloc and realloc */
+    double size_hist[NOCTAVES];   /* malloc and realloc requests by size */
+    double life_hist[NOCTAVES];   /* freed blocks by lifetime / requests */
+    double freed;                 /* blocks freed */
+    double unfreed;               /* blocks never freed */
+    double blocks;
+    double peak;                  /* peak live bytes */
+} summary_t;
+
+static void summarize(trace_t *trace, double size_scale, int copies,
+                      double shift, summary_t *s);
+static trace_t *downsample(trace_t *in, double fraction, uint64_t seed);
+static trace_t *amplify(trace_t *in, int copies, double shift,
+                        double size_scale);
+static int check(char *name, double in, double out, double expected,
+                 double tol);
+static int check_dist(char *name, double *out, double nout, 
+                      double *expected, double nexpected, double tol);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int c, copies = 1, off = 0;
+    double shift = -1, size_scale = 1, fraction = 1, tol = 0.1;
+    uint64_t seed = 1;
+    char *outfile = NULL;
+    trace_t *in, *out, *t;
+    summary_t si, se, so;
+
+    while ((c = getopt(argc, argv, "n:s:S:d:r:t:o:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Copies to interleave */
+            copies = atoi(optarg);
+            if (copies < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 's': /* Shift between copies, as a fraction of the trace */
+            shift = atof(optarg);
+            if (shift < 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'S': /* Scale request sizes */
+            size_scale = atof(optarg);
+            if (size_scale <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'd': /* Keep this fraction of the block ids */
+            fraction = atof(optarg);
+            if (fraction <= 0 || fraction > 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'r': /* Seed for choosing the ids to keep */
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 't': /* Tolerance of the checks */
+            tol = atof(optarg);
+            break;
+        case 'o': /* Write the new trace here */
+            outfile = optarg;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || outfile == NULL) {
+        usage();
+        exit(1);
+    }
+    if (shift < 0)
+        shift = 1.0 / copies;
+
+    in = read_trace("", argv[optind], 0);
+    out = in;
+    if (fraction < 1)
+        out = downsample(out, fraction, seed);
+    if (copies > 1 || size_scale != 1) {
+        t = amplify(out, copies, shift, size_scale);
+        if (out != in)
+            free_trace(out);
+        out = t;
+    }
+    write_trace(out, outfile);
+
+    /* Check the output against what the input predicts */
+    summarize(in, 1, 1, 0, &si);
+    summarize(in, size_scale, copies, shift, &se);
+    summarize(out, 1, 1, 0, &so);
+    printf("%s: %d requests, %d ids -> %s: %d requests, %d ids\n",
+           argv[optind], in->num_ops, in->num_ids, outfile, out->num_ops,
+           out->num_ids);
+    printf("%-22s%14s%14s%14s\n", "metric", "input", "output", "expected");
+    off += check("requests", si.ops, so.ops,
+                 si.ops * copies * fraction, tol);
+    off += check("malloc %", 100 * si.allocs / si.ops,
+                 100 * so.allocs / so.ops, 100 * si.allocs / si.ops, tol);
+    off += check("realloc %", 100 * si.reallocs / si.ops,
+                 100 * so.reallocs / so.ops, 100 * si.reallocs / si.ops, tol);
+    off += check("free %", 100 * si.frees / si.ops,
+                 100 * so.frees / so.ops, 100 * si.frees / si.ops, tol);
+    off += check("mean size", si.bytes / (si.allocs + si.reallocs),
+                 so.bytes / (so.allocs + so.reallocs),
+                 se.bytes / (se.allocs + se.reallocs), tol);
+    off += check_dist("size distance", so.size_hist, so.allocs + so.reallocs,
+                      se.size_hist, se.allocs + se.reallocs, tol);
+    off += check_dist("lifetime distance", so.life_hist, so.freed,
+                      se.life_hist, se.freed, tol);
+    off += check("never freed %", 100 * si.unfreed / si.blocks,
+                 100 * so.unfreed / so.blocks, 100 * si.unfreed / si.blocks,
+                 tol);
+    off += check("peak live bytes", si.peak, so.peak, se.peak * fraction, tol);
+    if (off)
+        printf("%d metrics are off by more than %.0f%%\n", off, tol * 100);
+
+    if (out != in)
+        free_trace(out);
+    free_trace(in);
+    exit(off ? 2 : 0);
+}
+
+/*
+ * scaled - A request size multiplied by scale, and still at least 1
+ *     byte if it was
+ */
+static int scaled(int size, double scale)
+{
+    double s = floor(size * scale + 0.5);
+
+    if (size > 0 && s < 1)
+        return 1;
+    return s > INT_MAX ? INT_MAX : (int)s;
+}
+
+static int octave(unsigned long v)
+{
+    return v < 2 ? 0 : 63 - __builtin_clzl(v);
+}
+
+/*
+ * copy_start - Where copy k of a trace of n requests starts when copies
+ *     are shift of its length apart, in requests of a single copy
+ */
+static long copy_start(int k, double shift, long n)
+{
+    return (long)floor(k * shift * n + 0.5);
+}
+
+/*
+ * placed - Where amplify puts request v of copy k, when the copies
+ *     start at start (ascending, with prefix sums in sum) and are n
+ *     requests long: after every request of an earlier point, and
+ *     after those of the earlier copies at the same one
+ */
+static double placed(long v, int k, long *start, double *sum, int copies,
+                     long n)
+{
+    int lo = 0, hi = copies, done, begun, mid;
+
+    /* Copies that have ended by v, then copies that have begun */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (start[mid] + n <= v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    done = lo;
+    hi = copies;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (start[mid] <= v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    begun = lo;
+    return (double)n * done + (double)(begun - done) * v - 
+        (sum[begun] - sum[done]) + (k > done ? k - done : 0);
+}
+
+/*
+ * summarize - Compute the summary metrics of a trace, as if its
+ *     request sizes were multiplied by size_scale. Lifetimes and the
+ *     peak live bytes are those of copies of it laid out as amplify
+ *     does, shift of its length apart; the counts are of one copy.
+ */
+static void summarize(trace_t *trace, double size_scale, int copies,
+                      double shift, summary_t *s)
+{
+    long *birth, *start, n = trace->num_ops, i, v;
+    double *delta, *sum, live = 0, total, life;
+    traceop_t *op;
+    int size, k, lo;
+
+    memset(s, 0, sizeof(*s));
+    if ((birth = malloc(trace->num_ids * sizeof(long))) == NULL ||
+        (delta = malloc((n + 1) * sizeof(double))) == NULL ||
+        (start = malloc(copies * sizeof(long))) == NULL ||
+        (sum = malloc((copies + 1) * sizeof(double))) == NULL) {
+        printf("malloc failed in summarize\n");
+        exit(1);
+    }
+    for (i = 0; i < trace->num_ids; i++) {
+        birth[i] = -1;
+        trace->block_sizes[i] = 0;
+    }
+    for (k = 0, sum[0] = 0; k < copies; k++) {
+        start[k] = copy_start(k, shift, n);
+        sum[k+1] = sum[k] + start[k];
+    }
+    total = (double)n * copies;
+
+    s->ops = n;
+    for (i = 0; i < n; i++) {
+        op = &trace->ops[i];
+        size = scaled(op->size, size_scale);
+        delta[i] = 0;
+        switch (op->type) {
+        case ALLOC:
+        case REALLOC:
+            if (op->type == ALLOC)
+                s->allocs++;
+            else
+                s->reallocs++;
+            s->bytes += size;
+            s->size_hist[octave(size)]++;
+            if (birth[op->index] < 0) {
+                birth[op->index] = i;
+                s->blocks++;
+            }
+            delta[i] = (double)size - trace->block_sizes[op->index];
+            trace->block_sizes[op->index] = size;
+            break;
+        case FREE:
+            s->frees++;
+            if (birth[op->index] < 0)
+                break;
+            for (k = 0; k < copies; k++) {
+                life = placed(i + start[k], k, start, sum, copies, n) -
+                    placed(birth[op->index] + start[k], k, start, sum, 
+                           copies, n);
+                s->life_hist[octave((unsigned long)(total / life))]++;
+            }
+            s->freed += copies;
+            birth[op->index] = -1;
+            delta[i] = -(double)trace->block_sizes[op->index];
+            trace->block_sizes[op->index] = 0;
+            break;
+        }
+    }
+    for (i = 0; i < trace->num_ids; i++)
+        if (birth[i] >= 0)
+            s->unfreed++;
+
+    /*
+     * Replay the changes in live bytes in the order amplify puts the
+     * copies' requests, skipping over any gap between copies. The
+     * copies before lo have ended, keeping what they never freed.
+     */
+    for (v = 0, lo = 0; lo < copies; v++) {
+        while (lo < copies && start[lo] + n <= v)
+            lo++;
+        if (lo < copies && start[lo] > v)
+            v = start[lo];
+        for (k = lo; k < copies && start[k] <= v; k++) {
+            live += delta[v - start[k]];
+            if (live > s->peak)
+                s->peak = live;
+        }
+    }
+    free(birth);
+    free(delta);
+    free(start);
+    free(sum);
+}
+
+/*
+ * keep_id - Whether downsampling keeps a block id: a hash of the id
+ *     (splitmix64) below fraction of its range
+ */
+static int keep_id(int id, double fraction, uint64_t seed)
+{
+    uint64_t z = seed + (uint64_t)id * 0x9e3779b97f4a7c15ULL;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / 9007199254740992.0) < fraction;
+}
+
+/*
+ * downsample - The requests of a random fraction of the block ids,
+ *     with the ids that are kept renumbered from 0
+ */
+static trace_t *downsample(trace_t *in, double fraction, uint64_t seed)
+{
+    trace_t *out;
+    int *newid, i, n = 0;
+
+    if ((out = calloc(1, sizeof(trace_t))) == NULL ||
+        (newid = malloc(in->num_ids * sizeof(int))) == NULL ||
+        (out->ops = malloc(in->num_ops * sizeof(traceop_t))) == NULL) {
+        printf("malloc failed in downsample\n");
+        exit(1);
+    }
+    for (i = 0; i < in->num_ids; i++)
+        newid[i] = keep_id(i, fraction, seed) ? out->num_ids++ : -1;
+    for (i = 0; i < in->num_ops; i++) {
+        if (newid[in->ops[i].index] < 0)
+            continue;
+        out->ops[n] = in->ops[i];
+        out->ops[n++].index = newid[in->ops[i].index];
+    }
+    out->num_ops = n;
+    out->weight = in->weight;
+    out->sugg_heapsize = (int)(in->sugg_heapsize * fraction);
+    if ((out->blocks = malloc((out->num_ids + 1) * sizeof(char *))) == NULL ||
+        (out->block_sizes = malloc((out->num_ids + 1) * sizeof(size_t)))
+        == NULL) {
+        printf("malloc failed in downsample\n");
+        exit(1);
+    }
+    free(newid);
+    return out;
+}
+
+/*
+ * amplify - Interleave copies of a trace, copy k using the block ids
+ *     from k * num_ids and starting k * shift * num_ops requests after
+ *     the first copy. Requests at the same point go in copy order.
+ */
+static trace_t *amplify(trace_t *in, int copies, double shift,
+                        double size_scale)
+{
+    trace_t *out;
+    long *start, v, end, j, n = 0;
+    int k;
+    double heap;
+
+    if ((double)in->num_ops * copies > INT_MAX ||
+        (double)in->num_ids * copies > INT_MAX) {
+        printf("%d copies of the trace would have too many requests\n",
+               copies);
+        exit(1);
+    }
+    if ((out = calloc(1, sizeof(trace_t))) == NULL ||
+        (start = malloc(copies * sizeof(long))) == NULL) {
+        printf("malloc failed in amplify\n");
+        exit(1);
+    }
+    out->num_ops = in->num_ops * copies;
+    out->num_ids = in->num_ids * copies;
+    out->weight = in->weight;
+    heap = (double)in->sugg_heapsize * copies * size_scale;
+    out->sugg_heapsize = heap > INT_MAX ? INT_MAX : (int)heap;
+    if ((out->ops = malloc(out->num_ops * sizeof(traceop_t))) == NULL ||
+        (out->blocks = malloc(out->num_ids * sizeof(char *))) == NULL ||
+        (out->block_sizes = malloc(out->num_ids * sizeof(size_t))) == NULL) {
+        printf("malloc failed in amplify\n");
+        exit(1);
+    }
+
+    for (k = 0, end = 0; k < copies; k++) {
+        start[k] = copy_start(k, shift, in->num_ops);
+        if (start[k] + in->num_ops > end)
+            end = start[k] + in->num_ops;
+    }
+    for (v = 0; v < end; v++) {
+        for (k = 0; k < copies; k++) {
+            j = v - start[k];
+            if (j < 0 || j >= in->num_ops)
+                continue;
+            out->ops[n] = in->ops[j];
+            out->ops[n].index += k * in->num_ids;
+            out->ops[n].size = scaled(in->ops[j].size, size_scale);
+            n++;
+        }
+    }
+    free(start);
+    return out;
+}
+
+/*
+ * check - Print one metric of the input and output, and whether the
+ *     output is within tol of the expected value (not checked if that
+ *     is 0). Returns 1 if it isn't.
+ */
+static int check(char *name, double in, double out, double expected,
+                 double tol)
+{
+    int off = expected != 0 && fabs(out - expected) > tol * expected;
+
+    if (expected != 0)
+        printf("%-22s%14.6g%14.6g%14.6g%s\n", name, in, out, expected,
+               off ? "  <-- off" : "");
+    else
+        printf("%-22s%14.6g%14.6g%14s\n", name, in, out, "-");
+    return off;
+}
+
+/*
+ * check_dist - Print the distance between the histogram out of nout
+ *     items and the expected one of nexpected: the fraction of the
+ *     items that would have to move bucket to make them match. Returns
+ *     1 if it is more than tol.
+ */
+static int check_dist(char *name, double *out, double nout, 
+                      double *expected, double nexpected, double tol)
+{
+    double dist = 0;
+    int i;
+
+    if (nout > 0 && nexpected > 0)
+        for (i = 0; i < NOCTAVES; i++)
+            dist += fabs(out[i] / nout - expected[i] / nexpected) / 2;
+    else if (nout > 0 || nexpected > 0)
+        dist = 1;
+    printf("%-22s%14s%14.3f%14.3f%s\n", name, "", dist, 0.0,
+           dist > tol ? "  <-- off" : "");
+    return dist > tol;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmscale [-h] [-n <copies>] [-s <shift>] "
+            "[-S <scale>] [-d <fraction>]\n"
+            "               [-r <seed>] [-t <tol>] -o <file> <trace>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-d <f>     Keep the requests of fraction <f> of the "
+            "block ids.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <n>     Interleave <n> copies of the trace.\n");
+    fprintf(stderr, "\t-o <file>  Write the new trace to <file> (binary if "
+            "it ends in .bin).\n");
+    fprintf(stderr, "\t-r <n>     Seed for choosing the ids -d keeps "
+            "(default 1).\n");
+    fprintf(stderr, "\t-s <f>     Start each copy <f> of the trace's length "
+            "after the one\n\t           before (default 1/<n>).\n");
+    fprintf(stderr, "\t-S <x>     Multiply request sizes by <x>.\n");
+    fprintf(stderr, "\t-t <f>     Flag metrics off by more than <f> "
+            "(default 0.1).\n");
+}
@@ -0,0 +1,996 @@
+/*
+ * mmsim.c - Predict how allocation policies would do on malloc traces,
+ *     without running an allocator
+ *
+ * The heap is modeled as extents of addresses: the allocated blocks and
+ * the free extents between them, kept in ordered maps (treaps) rather
+ * than in memory. Block sizes, splitting, heap growth and realloc
+ * follow mm.c, and what varies is the policy:
+ *
+ *   fit:        first, next, best or good (the first block in list
+ *               order within 1/GOOD_SLACK of the request, else best)
+ *   order:      free list order, lifo, fifo or addr
+ *   classes:    single (one list) or seg (mm.c's size classes, from
+ *               sizeclasses.h, searched from the request's class up)
+ *   coalescing: imm (on every free) or defer (only when a search fails,
+ *               before growing the heap)
+ *   placement:  low or high end of a split block
+ *   wilderness: wild (the free block that ends the heap is only used
+ *               when nothing else fits, as mm.c does) or nowild
+ *   chunk:      bytes to grow the heap by at least
+ *
+ * For each policy and trace it predicts the heap size and utilization
+ * (as mdriver computes it) and the number of free blocks a list walk
+ * would examine. The free extents of each class are indexed by list
+ * order, with the largest size in each subtree, and by size, with the
+ * earliest list position in each subtree, so every search is a few
+ * O(log n) tree walks however long the modeled list is.
+ *
+ *     unix> mmsim traces/short1-bal.rep        (mm.c's own policy)
+ *     unix> mmsim -p best,addr,seg -p next traces/short1-bal.rep
+ *     unix> mmsim -a -k 1024,4096,16384 traces/short1-bal.rep
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <stddef.h>
+
+#include "trace.h"
+#include "sizeclasses.h"
+
+/* mm.c's block layout */
+#define WSIZE       8        /* word size (bytes) */
+#define DSIZE       16       /* doubleword size (bytes) */
+#define OVERHEAD    16       /* overhead of header and footer (bytes) */
+#define MINSIZE     32       /* minimum block size (bytes) */
+#define PROLOGUE    (4 * WSIZE) /* heap bytes mm_init uses before the first block */
+#define CHUNKSIZE   (1<<12)  /* mm.c's heap growth */
+
+#define NCLASSES    SC_NCLASSES
+#define GOOD_SLACK  8        /* good fit accepts up to asize + asize/8 */
+#define MAXPOLICIES 4096
+#define MAXCHUNKS   16
+#define POOL_EXTENTS 4096
+
+enum {FIRST_FIT, NEXT_FIT, BEST_FIT, GOOD_FIT, NFITS};
+enum {ORDER_LIFO, ORDER_FIFO, ORDER_ADDR, NORDERS};
+static char *fit_names[] = {"first", "next", "best", "good"};
+static char *order_names[] = {"lifo", "fifo", "addr"};
+
+/* One policy variant */
+typedef struct {
+    int fit;
+    int order;
+    int seg;          /* size classes? */
+    int deferred;     /* deferred coalescing? */
+    int high;         /* place at the high end of a split block? */
+    int wild;         /* use the block that ends the heap last? */
+    size_t chunk;     /* minimum heap growth */
+} policy_t;
+
+/* A node of a treap, ordered by (k1, k2) */
+typedef struct node {
+    struct node *left, *right;
+    unsigned prio;
+    long k1, k2;
+    size_t size;           /* size of the extent */
+    size_t maxsize;        /* largest size in the subtree */
+    struct node *minnode;  /* node with the smallest k2 in the subtree */
+    long count;            /* nodes in the subtree */
+} node_t;
+
+/* A block or free extent of the modeled heap */
+typedef struct extent {
+    long addr;
+    size_t size;
+    int cls;            /* size class, while free */
+    long key;           /* position in its free list, while free */
+    node_t byaddr;      /* in the map of all free extents by address */
+    node_t bylist;      /* in its class's list, by key */
+    node_t bysize;      /* in its class's map by (size, key) */
+    struct extent *next_spare;
+} extent_t;
+
+#define EXTENT_OF(n, field) \
+    ((extent_t *)((char *)(n) - offsetof(extent_t, field)))
+
+/* Extents are carved from pools and recycled through a spare list */
+typedef struct pool {
+    struct pool *next;
+    int used;
+    extent_t extents[POOL_EXTENTS];
+} pool_t;
+
+/* The state of one simulation */
+typedef struct {
+    policy_t *p;
+    node_t *byaddr;
+    node_t *lists[NCLASSES];
+    node_t *sizes[NCLASSES];
+    long rover[NCLASSES];      /* next fit resumes at this list key */
+    long stamp;                /* for lifo and fifo list keys */
+    long brk;
+    extent_t **blocks;         /* each id's allocated block, or NULL */
+    size_t *payload;           /* and its requested size */
+    extent_t *spare;
+    pool_t *pools;
+    extent_t **scratch;        /* for deferred coalescing */
+    long nscratch;
+    double steps;
+    double live, peak;
+} sim_t;
+
+/* What a policy did on one trace */
+typedef struct {
+    double heap;
+    double util;
+    double steps;
+} result_t;
+
+/* A policy's results over all the traces */
+typedef struct {
+    policy_t policy;
+    double util;        /* weighted by the traces' weights */
+    double heap;        /* summed over the traces */
+    double steps;
+    double ops;
+} summary_t;
+
+static void parse_policy(char *spec, policy_t *p);
+static void policy_name(policy_t *p, char *buf);
+static void simulate(trace_t *trace, policy_t *p, result_t *r);
+static int cmp_summary(const void *a, const void *b);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int c, i, j, t, ntraces, npolicies = 0, sweep = 0, verbose = 0;
+    int nchunks = 0;
+    size_t chunks[MAXCHUNKS];
+    char *tok, name[64];
+    FILE *csv = NULL;
+    trace_t **traces;
+    policy_t *policies;
+    summary_t *sums;
+    result_t r;
+    double weight;
+    int fit, order, seg, deferred, high, wild;
+
+    if ((policies = malloc(MAXPOLICIES * sizeof(policy_t))) == NULL) {
+        printf("malloc failed in main\n");
+        exit(1);
+    }
+    while ((c = getopt(argc, argv, "p:ak:c:vh")) != EOF) {
+        switch (c) {
+        case 'p': /* Simulate this policy */
+            if (npolicies == MAXPOLICIES) {
+                printf("Too many policies\n");
+                exit(1);
+            }
+            parse_policy(optarg, &policies[npolicies++]);
+            break;
+        case 'a': /* Sweep every combination */
+            sweep = 1;
+            break;
+        case 'k': /* Heap growth sizes for the sweep */
+            for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+                if (nchunks == MAXCHUNKS || atol(tok) < MINSIZE) {
+                    usage();
+                    exit(1);
+                }
+                chunks[nchunks++] = atol(tok);
+            }
+            break;
+        case 'c': /* Write per-trace results as CSV */
+            if ((csv = fopen(optarg, "w")) == NULL) {
+                printf("Could not open %s for -c\n", optarg);
+                exit(1);
+            }
+            fprintf(csv, "policy,trace,heap,util,steps,ops\n");
+            break;
+        case 'v': /* Print per-trace results */
+            verbose = 1;
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+
+    if (nchunks == 0)
+        chunks[nchunks++] = CHUNKSIZE;
+    if (sweep) {
+        for (fit = 0; fit < NFITS; fit++)
+         for (order = 0; order < NORDERS; order++)
+          for (seg = 0; seg < 2; seg++)
+           for (deferred = 0; deferred < 2; deferred++)
+            for (high = 0; high < 2; high++)
+             for (wild = 0; wild < 2; wild++)
+              for (i = 0; i < nchunks; i++) {
+                 if (npolicies == MAXPOLICIES) {
+                     printf("Too many policies\n");
+                     exit(1);
+                 }
+                 policies[npolicies].fit = fit;
+                 policies[npolicies].order = order;
+                 policies[npolicies].seg = seg;
+                 policies[npolicies].deferred = deferred;
+                 policies[npolicies].high = high;
+                 policies[npolicies].wild = wild;
+                 policies[npolicies++].chunk = chunks[i];
+             }
+    }
+    if (npolicies == 0)
+        parse_policy("", &policies[npolicies++]);
+
+    ntraces = argc - optind;
+    if ((traces = malloc(ntraces * sizeof(trace_t *))) == NULL ||
+        (sums = calloc(npolicies, sizeof(summary_t))) == NULL) {
+        printf("malloc failed in main\n");
+        exit(1);
+    }
+    for (t = 0; t < ntraces; t++)
+        traces[t] = read_trace("", argv[optind + t], 0);
+
+    for (i = 0; i < npolicies; i++) {
+        sums[i].policy = policies[i];
+        policy_name(&policies[i], name);
+        if (verbose)
+            printf("%s:\n", name);
+        weight = 0;
+        for (t = 0; t < ntraces; t++) {
+            simulate(traces[t], &policies[i], &r);
+            sums[i].util += traces[t]->weight * r.util;
+            weight += traces[t]->weight;
+            sums[i].heap += r.heap;
+            sums[i].steps += r.steps;
+            sums[i].ops += traces[t]->num_ops;
+            if (verbose)
+                printf("  %-40s %10.0f %6.1f%% %8.2f\n", argv[optind + t],
+                       r.heap, r.util * 100.0, r.steps / traces[t]->num_ops);
+            if (csv)
+                fprintf(csv, "%s,%s,%.0f,%.6f,%.0f,%d\n", name,
+                        argv[optind + t], r.heap, r.util, r.steps,
+                        traces[t]->num_ops);
+        }
+        sums[i].util = weight > 0 ? sums[i].util / weight : 0;
+    }
+
+    /* Best utilization first */
+    qsort(sums, npolicies, sizeof(summary_t), cmp_summary);
+    printf("%-40s %7s %12s %10s\n", "policy", "util", "heap", "steps/req");
+    for (i = 0; i < npolicies; i++) {
+        policy_name(&sums[i].policy, name);
+        printf("%-40s %6.1f%% %12.0f %10.2f\n", name, sums[i].util * 100.0,
+               sums[i].heap, sums[i].steps / sums[i].ops);
+    }
+
+    if (csv)
+        fclose(csv);
+    for (j = 0; j < ntraces; j++)
+        free_trace(traces[j]);
+    free(traces);
+    free(sums);
+    free(policies);
+    exit(0);
+}
+
+/*
+ * parse_policy - Read a policy from comma-separated words, any of
+ *     which may be left out to get mm.c's choice
+ */
+static void parse_policy(char *spec, policy_t *p)
+{
+    char buf[256], *tok;
+    int i;
+
+    p->fit = FIRST_FIT;
+    p->order = ORDER_LIFO;
+    p->seg = 1;
+    p->deferred = 0;
+    p->high = 0;
+    p->wild = 1;
+    p->chunk = CHUNKSIZE;
+
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    for (tok = strtok(buf, ","); tok; tok = strtok(NULL, ",")) {
+        for (i = 0; i < NFITS && strcmp(tok, fit_names[i]); i++)
+            ;
+        if (i < NFITS) {
+            p->fit = i;
+            continue;
+        }
+        for (i = 0; i < NORDERS && strcmp(tok, order_names[i]); i++)
+            ;
+        if (i < NORDERS)
+            p->order = i;
+        else if (!strcmp(tok, "seg") || !strcmp(tok, "single"))
+            p->seg = !strcmp(tok, "seg");
+        else if (!strcmp(tok, "imm") || !strcmp(tok, "defer"))
+            p->deferred = !strcmp(tok, "defer");
+        else if (!strcmp(tok, "low") || !strcmp(tok, "high"))
+            p->high = !strcmp(tok, "high");
+        else if (!strcmp(tok, "wild") || !strcmp(tok, "nowild"))
+            p->wild = !strcmp(tok, "wild");
+        else if (atol(tok) >= MINSIZE)
+            p->chunk = atol(tok);
+        else {
+            printf("Unknown policy word \"%s\" in \"%s\"\n", tok, spec);
+            exit(1);
+        }
+    }
+}
+
+/*
+ * policy_name - The words parse_policy would read back as p
+ */
+static void policy_name(policy_t *p, char *buf)
+{
+    sprintf(buf, "%s,%s,%s,%s,%s,%s,%lu", fit_names[p->fit],
+            order_names[p->order], p->seg ? "seg" : "single",
+            p->deferred ? "defer" : "imm", p->high ? "high" : "low",
+            p->wild ? "wild" : "nowild", (unsigned long)p->chunk);
+}
+
+static int cmp_summary(const void *a, const void *b)
+{
+    const summary_t *x = a, *y = b;
+    if (x->util != y->util)
+        return (x->util < y->util) ? 1 : -1;
+    return (x->steps > y->steps) - (x->steps < y->steps);
+}
+
+/***********
+ * Treaps
+ ***********/
+
+static unsigned next_prio(void)
+{
+    static unsigned x = 2463534242U;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+static long count(node_t *t)
+{
+    return t ? t->count : 0;
+}
+
+static size_t maxsize(node_t *t)
+{
+    return t ? t->maxsize : 0;
+}
+
+static void update(node_t *t)
+{
+    t->count = 1 + count(t->left) + count(t->right);
+    t->maxsize = t->size;
+    t->minnode = t;
+    if (t->left) {
+        if (t->left->maxsize > t->maxsize)
+            t->maxsize = t->left->maxsize;
+        if (t->left->minnode->k2 < t->minnode->k2)
+            t->minnode = t->left->minnode;
+    }
+    if (t->right) {
+        if (t->right->maxsize > t->maxsize)
+            t->maxsize = t->right->maxsize;
+        if (t->right->minnode->k2 < t->minnode->k2)
+            t->minnode = t->right->minnode;
+    }
+}
+
+/* Is t's key before (k1, k2)? */
+static int before(node_t *t, long k1, long k2)
+{
+    return t->k1 < k1 || (t->k1 == k1 && t->k2 < k2);
+}
+
+/*
+ * split - Split t into the nodes before (k1, k2) and the rest
+ */
+static void split(node_t *t, long k1, long k2, node_t **a, node_t **b)
+{
+    if (t == NULL) {
+        *a = *b = NULL;
+        return;
+    }
+    if (before(t, k1, k2)) {
+        split(t->right, k1, k2, &t->right, b);
+        *a = t;
+    }
+    else {
+        split(t->left, k1, k2, a, &t->left);
+        *b = t;
+    }
+    update(t);
+}
+
+/*
+ * merge - Join a and b, all of whose keys come after a's
+ */
+static node_t *merge(node_t *a, node_t *b)
+{
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+    if (a->prio > b->prio) {
+        a->right = merge(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = merge(a, b->left);
+    update(b);
+    return b;
+}
+
+static void tree_insert(node_t **root, node_t *n, long k1, long k2,
+                        size_t size)
+{
+    node_t *a, *b;
+
+    n->left = n->right = NULL;
+    n->prio = next_prio();
+    n->k1 = k1;
+    n->k2 = k2;
+    n->size = size;
+    update(n);
+    split(*root, k1, k2, &a, &b);
+    *root = merge(merge(a, n), b);
+}
+
+static node_t *tree_remove(node_t *t, node_t *n)
+{
+    if (t == n)
+        return merge(t->left, t->right);
+    if (before(n, t->k1, t->k2))
+        t->left = tree_remove(t->left, n);
+    else
+        t->right = tree_remove(t->right, n);
+    update(t);
+    return t;
+}
+
+/*
+ * first_fit - The first node of at least asize bytes, and the number
+ *     of nodes before it
+ */
+static node_t *first_fit(node_t *t, size_t asize, long *rank)
+{
+    *rank = 0;
+    while (t && t->maxsize >= asize) {
+        if (maxsize(t->left) >= asize)
+            t = t->left;
+        else if (t->size >= asize) {
+            *rank += count(t->left);
+            return t;
+        }
+        else {
+            *rank += count(t->left) + 1;
+            t = t->right;
+        }
+    }
+    return NULL;
+}
+
+/* The first node at or after (k1, k2) */
+static node_t *lower_bound(node_t *t, long k1, long k2)
+{
+    node_t *found = NULL;
+
+    while (t) {
+        if (before(t, k1, k2))
+            t = t->right;
+        else {
+            found = t;
+            t = t->left;
+        }
+    }
+    return found;
+}
+
+/* The last node before (k1, k2) */
+static node_t *last_before(node_t *t, long k1, long k2)
+{
+    node_t *found = NULL;
+
+    while (t) {
+        if (before(t, k1, k2)) {
+            found = t;
+            t = t->right;
+        }
+        else
+            t = t->left;
+    }
+    return found;
+}
+
+/* The number of nodes before (k1, k2) */
+static long rank_of(node_t *t, long k1, long k2)
+{
+    long rank = 0;
+
+    while (t) {
+        if (before(t, k1, k2)) {
+            rank += count(t->left) + 1;
+            t = t->right;
+        }
+        else
+            t = t->left;
+    }
+    return rank;
+}
+
+/*
+ * min_in_range - Of the nodes with k1 in [lo, hi], the one with the
+ *     smallest k2
+ */
+static node_t *min_in_range(node_t **root, long lo, long hi)
+{
+    node_t *a, *b, *c, *found;
+
+    split(*root, lo, LONG_MIN, &a, &b);
+    split(b, hi + 1, LONG_MIN, &b, &c);
+    found = b ? b->minnode : NULL;
+    *root = merge(a, merge(b, c));
+    return found;
+}
+
+/*************
+ * The heap
+ *************/
+
+static extent_t *new_extent(sim_t *s, long addr, size_t size)
+{
+    extent_t *e;
+    pool_t *pool;
+
+    if ((e = s->spare) != NULL)
+        s->spare = e->next_spare;
+    else {
+        if (s->pools == NULL || s->pools->used == POOL_EXTENTS) {
+            if ((pool = malloc(sizeof(pool_t))) == NULL) {
+                printf("malloc failed in new_extent\n");
+                exit(1);
+            }
+            pool->next = s->pools;
+            pool->used = 0;
+            s->pools = pool;
+        }
+        e = &s->pools->extents[s->pools->used++];
+    }
+    e->addr = addr;
+    e->size = size;
+    return e;
+}
+
+static void put_extent(sim_t *s, extent_t *e)
+{
+    e->next_spare = s->spare;
+    s->spare = e;
+}
+
+static int size_class(size_t size)
+{
+    return SC_CLASS(size);
+}
+
+/* Same as mm_adjusted_size */
+static size_t adjusted_size(size_t size)
+{
+    if (size <= DSIZE)
+        return DSIZE + OVERHEAD;
+    return DSIZE * ((size + OVERHEAD + (DSIZE - 1)) / DSIZE);
+}
+
+static void insert_free(sim_t *s, extent_t *e)
+{
+    e->cls = s->p->seg ? size_class(e->size) : 0;
+    switch (s->p->order) {
+    case ORDER_LIFO:
+        e->key = -(++s->stamp);
+        break;
+    case ORDER_FIFO:
+        e->key = ++s->stamp;
+        break;
+    default:
+        e->key = e->addr;
+    }
+    tree_insert(&s->byaddr, &e->byaddr, e->addr, 0, e->size);
+    tree_insert(&s->lists[e->cls], &e->bylist, e->key, 0, e->size);
+    tree_insert(&s->sizes[e->cls], &e->bysize, (long)e->size, e->key,
+                e->size);
+}
+
+static void remove_free(sim_t *s, extent_t *e)
+{
+    s->byaddr = tree_remove(s->byaddr, &e->byaddr);
+    s->lists[e->cls] = tree_remove(s->lists[e->cls], &e->bylist);
+    s->sizes[e->cls] = tree_remove(s->sizes[e->cls], &e->bysize);
+}
+
+/* The free extent that starts where e ends, if any */
+static extent_t *free_after(sim_t *s, extent_t *e)
+{
+    node_t *n = lower_bound(s->byaddr, e->addr + (long)e->size, 0);
+    extent_t *x = n ? EXTENT_OF(n, byaddr) : NULL;
+
+    return (x && x->addr == e->addr + (long)e->size) ? x : NULL;
+}
+
+/* The free extent that ends where e starts, if any */
+static extent_t *free_before(sim_t *s, extent_t *e)
+{
+    node_t *n = last_before(s->byaddr, e->addr, 0);
+    extent_t *x = n ? EXTENT_OF(n, byaddr) : NULL;
+
+    return (x && x->addr + (long)x->size == e->addr) ? x : NULL;
+}
+
+/*
+ * coalesce - Merge e with the free extents on either side and put the
+ *     result on the free lists
+ */
+static extent_t *coalesce(sim_t *s, extent_t *e)
+{
+    extent_t *x;
+
+    if ((x = free_after(s, e)) != NULL) {
+        remove_free(s, x);
+        e->size += x->size;
+        put_extent(s, x);
+    }
+    if ((x = free_before(s, e)) != NULL) {
+        remove_free(s, x);
+        x->size += e->size;
+        put_extent(s, e);
+        e = x;
+    }
+    insert_free(s, e);
+    return e;
+}
+
+/* Free e, coalescing unless that is deferred */
+static void release(sim_t *s, extent_t *e)
+{
+    if (s->p->deferred)
+        insert_free(s, e);
+    else
+        coalesce(s, e);
+}
+
+static void collect(sim_t *s, node_t *t)
+{
+    if (t == NULL)
+        return;
+    collect(s, t->left);
+    s->scratch[s->nscratch++] = EXTENT_OF(t, byaddr);
+    collect(s, t->right);
+}
+
+/*
+ * coalesce_all - Merge every run of adjacent free extents, for
+ *     deferred coalescing
+ */
+static void coalesce_all(sim_t *s)
+{
+    long i, j;
+    extent_t *e;
+
+    if ((s->scratch = realloc(s->scratch,
+                              count(s->byaddr) * sizeof(extent_t *))) == NULL
+        && count(s->byaddr) > 0) {
+        printf("realloc failed in coalesce_all\n");
+        exit(1);
+    }
+    s->nscratch = 0;
+    collect(s, s->byaddr);
+    for (i = 0; i < s->nscratch; i = j) {
+        e = s->scratch[i];
+        for (j = i + 1; j < s->nscratch &&
+                 s->scratch[j]->addr == e->addr + (long)e->size; j++)
+            ;
+        if (j == i + 1)
+            continue;
+        remove_free(s, e);
+        for (j = i + 1; j < s->nscratch &&
+                 s->scratch[j]->addr == e->addr + (long)e->size; j++) {
+            remove_free(s, s->scratch[j]);
+            e->size += s->scratch[j]->size;
+            put_extent(s, s->scratch[j]);
+        }
+        insert_free(s, e);
+    }
+}
+
+/*
+ * search_class - Find a free extent of at least asize bytes in class c,
+ *     counting the blocks a walk of the class's list would examine
+ */
+static extent_t *search_class(sim_t *s, int c, size_t asize)
+{
+    node_t *list = s->lists[c], *n = NULL, *a, *b;
+    long rank = 0, total = count(list);
+    size_t hi;
+
+    if (total == 0 || list->maxsize < asize) {
+        s->steps += total;
+        return NULL;
+    }
+    switch (s->p->fit) {
+    case FIRST_FIT:
+        n = first_fit(list, asize, &rank);
+        break;
+    case NEXT_FIT:
+        split(list, s->rover[c], LONG_MIN, &a, &b);
+        if ((n = first_fit(b, asize, &rank)) == NULL) {
+            n = first_fit(a, asize, &rank);
+            rank += count(b);
+        }
+        s->lists[c] = merge(a, b);
+        s->rover[c] = n->k1;
+        break;
+    default:
+        /* A walk stops at the first close enough fit... */
+        hi = (s->p->fit == BEST_FIT) ? asize : asize + asize / GOOD_SLACK;
+        if ((n = min_in_range(&s->sizes[c], asize, hi)) != NULL) {
+            n = &EXTENT_OF(n, bysize)->bylist;
+            rank = rank_of(list, n->k1, n->k2);
+        }
+        /* ...or examines the whole list for the smallest */
+        else {
+            n = lower_bound(s->sizes[c], asize, LONG_MIN);
+            n = &EXTENT_OF(n, bysize)->bylist;
+            rank = total - 1;
+        }
+    }
+    s->steps += rank + 1;
+    return EXTENT_OF(n, bylist);
+}
+
+static extent_t *search(sim_t *s, size_t asize)
+{
+    int c;
+    extent_t *e;
+
+    if (!s->p->seg)
+        return search_class(s, 0, asize);
+    for (c = size_class(asize); c < NCLASSES; c++)
+        if ((e = search_class(s, c, asize)) != NULL)
+            return e;
+    return NULL;
+}
+
+/*
+ * find_fit - Search the free lists, leaving the free extent that ends
+ *     the heap out of the search under the wild policy
+ */
+static extent_t *find_fit(sim_t *s, size_t asize)
+{
+    node_t *n;
+    extent_t *tail = NULL, *e;
+
+    if (s->p->wild && (n = last_before(s->byaddr, s->brk, 0)) != NULL &&
+        EXTENT_OF(n, byaddr)->addr + (long)EXTENT_OF(n, byaddr)->size ==
+        s->brk) {
+        tail = EXTENT_OF(n, byaddr);
+        s->lists[tail->cls] = tree_remove(s->lists[tail->cls], &tail->bylist);
+        s->sizes[tail->cls] = tree_remove(s->sizes[tail->cls], &tail->bysize);
+    }
+    e = search(s, asize);
+    if (tail) {
+        tree_insert(&s->lists[tail->cls], &tail->bylist, tail->key, 0,
+                    tail->size);
+        tree_insert(&s->sizes[tail->cls], &tail->bysize, (long)tail->size,
+                    tail->key, tail->size);
+        if (e == NULL && tail->size >= asize) {
+            s->steps++;
+            e = tail;
+        }
+    }
+    return e;
+}
+
+/*
+ * grow - Extend the heap by size bytes, returning the free extent that
+ *     ends the heap
+ */
+static extent_t *grow(sim_t *s, size_t size)
+{
+    extent_t *e;
+
+    size = ((size + DSIZE - 1) / DSIZE) * DSIZE;
+    e = new_extent(s, s->brk, size);
+    s->brk += size;
+    return coalesce(s, e);
+}
+
+/*
+ * shrink - Return the end of an allocated block if it can be a block
+ */
+static void shrink(sim_t *s, extent_t *e, size_t asize)
+{
+    size_t rest = e->size - asize;
+
+    if (rest < MINSIZE)
+        return;
+    e->size = asize;
+    release(s, new_extent(s, e->addr + asize, rest));
+}
+
+/*
+ * place - Allocate asize bytes of free extent e
+ */
+static extent_t *place(sim_t *s, extent_t *e, size_t asize)
+{
+    size_t rest = e->size - asize;
+    extent_t *r;
+
+    remove_free(s, e);
+    if (rest < MINSIZE)
+        return e;
+    if (s->p->high) {
+        r = new_extent(s, e->addr, rest);
+        e->addr += rest;
+    }
+    else
+        r = new_extent(s, e->addr + asize, rest);
+    e->size = asize;
+    release(s, r);
+    return e;
+}
+
+static extent_t *sim_malloc(sim_t *s, size_t size)
+{
+    size_t asize;
+    extent_t *e;
+
+    if (size == 0)
+        return NULL;
+    asize = adjusted_size(size);
+    if ((e = find_fit(s, asize)) == NULL && s->p->deferred) {
+        coalesce_all(s);
+        e = find_fit(s, asize);
+    }
+    if (e == NULL)
+        e = grow(s, asize > s->p->chunk ? asize : s->p->chunk);
+    return place(s, e, asize);
+}
+
+/*
+ * sim_realloc - Resize a block the way mm_realloc does
+ */
+static extent_t *sim_realloc(sim_t *s, extent_t *e, size_t size)
+{
+    size_t asize, avail;
+    extent_t *next;
+
+    if (e == NULL)
+        return sim_malloc(s, size);
+    if (size == 0) {
+        release(s, e);
+        return NULL;
+    }
+    asize = adjusted_size(size);
+    if (asize <= e->size) {
+        shrink(s, e, asize);
+        return e;
+    }
+
+    /* Grow the heap under a block that ends it */
+    next = free_after(s, e);
+    avail = e->size + (next ? next->size : 0);
+    if (e->addr + (long)avail == s->brk && avail < asize) {
+        grow(s, (asize - avail > MINSIZE) ? asize - avail : MINSIZE);
+        next = free_after(s, e);
+    }
+
+    if (next && e->size + next->size >= asize) {
+        remove_free(s, next);
+        e->size += next->size;
+        put_extent(s, next);
+        shrink(s, e, asize);
+        return e;
+    }
+    next = sim_malloc(s, size);
+    release(s, e);
+    return next;
+}
+
+/*
+ * simulate - Replay a trace under policy p
+ */
+static void simulate(trace_t *trace, policy_t *p, result_t *r)
+{
+    sim_t s;
+    traceop_t *op;
+    pool_t *pool;
+    int i;
+
+    memset(&s, 0, sizeof(s));
+    s.p = p;
+    if ((s.blocks = calloc(trace->num_ids, sizeof(extent_t *))) == NULL ||
+        (s.payload = calloc(trace->num_ids, sizeof(size_t))) == NULL) {
+        printf("calloc failed in simulate\n");
+        exit(1);
+    }
+    for (i = 0; i < NCLASSES; i++)
+        s.rover[i] = LONG_MIN;
+
+    /* The heap starts like mm_init's */
+    s.brk = PROLOGUE;
+    grow(&s, p->chunk);
+
+    for (i = 0; i < trace->num_ops; i++) {
+        op = &trace->ops[i];
+        switch (op->type) {
+        case ALLOC:
+            s.blocks[op->index] = sim_malloc(&s, op->size);
+            s.payload[op->index] = op->size;
+            s.live += op->size;
+            break;
+        case REALLOC:
+            s.blocks[op->index] =
+                sim_realloc(&s, s.blocks[op->index], op->size);
+            s.live += (double)op->size - s.payload[op->index];
+            s.payload[op->index] = op->size;
+            break;
+        case FREE:
+            if (s.blocks[op->index])
+                release(&s, s.blocks[op->index]);
+            s.blocks[op->index] = NULL;
+            s.live -= s.payload[op->index];
+            s.payload[op->index] = 0;
+            break;
+        }
+        if (s.live > s.peak)
+            s.peak = s.live;
+    }
+
+    r->heap = s.brk;
+    r->util = s.peak / s.brk;
+    r->steps = s.steps;
+
+    while ((pool = s.pools) != NULL) {
+        s.pools = pool->next;
+        free(pool);
+    }
+    free(s.blocks);
+    free(s.payload);
+    free(s.scratch);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmsim [-hav] [-p <policy>]... [-k <bytes>,...] "
+            "[-c <file>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a         Sweep every fit, order, class, coalescing "
+            "and placement choice.\n");
+    fprintf(stderr, "\t-c <file>  Also write per-trace results as CSV.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-k <n,...> Heap growth sizes for -a (default %d).\n",
+            CHUNKSIZE);
+    fprintf(stderr, "\t-p <words> Simulate a policy: comma-separated words "
+            "from\n\t           first|next|best|good, lifo|fifo|addr, "
+            "single|seg,\n\t           imm|defer, low|high, wild|nowild and a "
+            "heap growth\n\t           size; mm.c's choices fill in any "
+            "left out.\n");
+    fprintf(stderr, "\t-v         Print per-trace results.\n");
+}
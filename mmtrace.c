@@ -0,0 +1,410 @@
+/*
+ * mmtrace.c - Describe the workload in malloc trace files
+ *
+ * For each trace, prints the request size histogram and the most
+ * common sizes, the distribution of block lifetimes (in requests,
+ * from malloc to free), how far reallocs grow or shrink blocks, the
+ * peak live bytes and blocks, and the live bytes and blocks at evenly
+ * spaced points of the trace. With -c the live curve is also written
+ * as CSV. Everything is computed in a single pass over the requests
+ * with fixed-size histograms, so the time is dominated by read_trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+
+#include "trace.h"
+
+#define NOCTAVES   32     /* power-of-two histogram buckets */
+#define SUBBUCKETS 8      /* lifetime buckets per power of two */
+#define MAXPOINTS  10000  /* max points on the live curve */
+
+static char *ratio_names[] = {
+    "< 0.5", "0.5-1", "1", "1-1.25", "1.25-1.5", "1.5-2", "2-4", ">= 4"
+};
+#define NRATIOS (int)(sizeof(ratio_names) / sizeof(ratio_names[0]))
+
+/* Count of requests of one size, for the most common sizes */
+typedef struct {
+    unsigned size;
+    unsigned long count;
+} sizecount_t;
+
+/* A point on the live curve */
+typedef struct {
+    long op;
+    double bytes;
+    long blocks;
+} point_t;
+
+/* Everything reported for one trace */
+typedef struct {
+    long allocs, frees, reallocs;
+    double bytes_requested;
+    unsigned long size_count[NOCTAVES];
+    double size_bytes[NOCTAVES];
+    sizecount_t *sizes;          /* open-addressing table of exact sizes */
+    unsigned long nsizes, size_slots;
+    unsigned long life[NOCTAVES * SUBBUCKETS];
+    long nlife, unfreed;
+    double total_life;
+    unsigned long ratio[NRATIOS];
+    double log_ratio;            /* sum of log(new/old), for the mean */
+    double peak_bytes;
+    long peak_blocks, peak_op;
+    int npoints;
+    point_t points[MAXPOINTS];
+} stats_t;
+
+static void analyze(char *path, int npoints, int top, FILE *csv);
+static void print_stats(stats_t *s, int top);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    int c;
+    int npoints = 20, top = 10;
+    FILE *csv = NULL;
+
+    while ((c = getopt(argc, argv, "n:t:c:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Points on the live curve */
+            npoints = atoi(optarg);
+            if (npoints < 1 || npoints > MAXPOINTS) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 't': /* Most common sizes to list */
+            top = atoi(optarg);
+            break;
+        case 'c': /* Write the live curves as CSV */
+            if ((csv = fopen(optarg, "w")) == NULL) {
+                printf("Could not open %s for -c\n", optarg);
+                exit(1);
+            }
+            fprintf(csv, "trace,op,live_bytes,live_blocks\n");
+            break;
+        case 'h': /* Print this message */
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc) {
+        usage();
+        exit(1);
+    }
+    for (; optind < argc; optind++)
+        analyze(argv[optind], npoints, top, csv);
+    if (csv)
+        fclose(csv);
+    exit(0);
+}
+
+/*
+ * octave - The power-of-two bucket of v: 0 for v < 2, else floor(log2 v)
+ */
+static int octave(unsigned long v)
+{
+    return v < 2 ? 0 : 63 - __builtin_clzl(v);
+}
+
+/*
+ * life_bucket - Bucket of a lifetime: SUBBUCKETS linear steps per
+ *     power of two
+ */
+static int life_bucket(unsigned long v)
+{
+    int o = octave(v);
+
+    if (o < 3)
+        return v;   /* exact below 2^3 = SUBBUCKETS */
+    return o * SUBBUCKETS + (int)((v >> (o - 3)) & (SUBBUCKETS - 1));
+}
+
+/* The smallest lifetime in bucket b */
+static unsigned long life_bucket_lo(int b)
+{
+    int o = b / SUBBUCKETS;
+
+    if (b < SUBBUCKETS)
+        return b;
+    return (unsigned long)(SUBBUCKETS + b % SUBBUCKETS) << (o - 3);
+}
+
+/*
+ * count_size - Count one request of size bytes in the exact-size table
+ */
+static void count_size(stats_t *s, unsigned size)
+{
+    unsigned long i, j, n;
+    sizecount_t *old;
+
+    if (2 * (s->nsizes + 1) > s->size_slots) {
+        old = s->sizes;
+        n = s->size_slots;
+        s->size_slots = n ? 2 * n : 1024;
+        if ((s->sizes = calloc(s->size_slots, sizeof(sizecount_t))) == NULL) {
+            printf("calloc failed in count_size\n");
+            exit(1);
+        }
+        for (i = 0; i < n; i++) {
+            if (old[i].count == 0)
+                continue;
+            for (j = (old[i].size * 2654435761UL) & (s->size_slots - 1);
+                 s->sizes[j].count; j = (j + 1) & (s->size_slots - 1))
+                ;
+            s->sizes[j] = old[i];
+        }
+        free(old);
+    }
+    for (i = (size * 2654435761UL) & (s->size_slots - 1);
+         s->sizes[i].count && s->sizes[i].size != size;
+         i = (i + 1) & (s->size_slots - 1))
+        ;
+    if (s->sizes[i].count == 0) {
+        s->sizes[i].size = size;
+        s->nsizes++;
+    }
+    s->sizes[i].count++;
+}
+
+static void count_request(stats_t *s, unsigned size)
+{
+    int o = octave(size);
+
+    s->size_count[o]++;
+    s->size_bytes[o] += size;
+    s->bytes_requested += size;
+    count_size(s, size);
+}
+
+static int ratio_bucket(double r)
+{
+    if (r < 0.5)  return 0;
+    if (r < 1)    return 1;
+    if (r == 1)   return 2;
+    if (r < 1.25) return 3;
+    if (r < 1.5)  return 4;
+    if (r < 2)    return 5;
+    if (r < 4)    return 6;
+    return 7;
+}
+
+/*
+ * analyze - Read one trace and print its profile
+ */
+static void analyze(char *path, int npoints, int top, FILE *csv)
+{
+    trace_t *trace = read_trace("", path, 0);
+    stats_t *s;
+    long *birth;             /* op that allocated each live id, or -1 */
+    long i, next_point, live_blocks = 0;
+    double live_bytes = 0;
+    traceop_t *op;
+    int p;
+
+    if ((s = calloc(1, sizeof(stats_t))) == NULL ||
+        (birth = malloc(trace->num_ids * sizeof(long))) == NULL) {
+        printf("malloc failed in analyze\n");
+        exit(1);
+    }
+    for (i = 0; i < trace->num_ids; i++) {
+        birth[i] = -1;
+        trace->block_sizes[i] = 0;
+    }
+
+    next_point = trace->num_ops / npoints;
+    for (i = 0; i < trace->num_ops; i++) {
+        op = &trace->ops[i];
+        switch (op->type) {
+        case ALLOC:
+            s->allocs++;
+            count_request(s, op->size);
+            birth[op->index] = i;
+            trace->block_sizes[op->index] = op->size;
+            live_bytes += op->size;
+            live_blocks++;
+            break;
+        case REALLOC:
+            s->reallocs++;
+            count_request(s, op->size);
+            if (birth[op->index] < 0) {   /* realloc of a free id */
+                birth[op->index] = i;
+                live_blocks++;
+            }
+            else if (trace->block_sizes[op->index] > 0) {
+                double r = (double)op->size / trace->block_sizes[op->index];
+                s->ratio[ratio_bucket(r)]++;
+                s->log_ratio += log(r);
+            }
+            live_bytes += (double)op->size - trace->block_sizes[op->index];
+            trace->block_sizes[op->index] = op->size;
+            break;
+        case FREE:
+            s->frees++;
+            if (birth[op->index] >= 0) {
+                s->life[life_bucket(i - birth[op->index])]++;
+                s->total_life += i - birth[op->index];
+                s->nlife++;
+                birth[op->index] = -1;
+                live_bytes -= trace->block_sizes[op->index];
+                live_blocks--;
+            }
+            break;
+        }
+        if (live_bytes > s->peak_bytes) {
+            s->peak_bytes = live_bytes;
+            s->peak_op = i;
+        }
+        if (live_blocks > s->peak_blocks)
+            s->peak_blocks = live_blocks;
+
+        /* Sample the live curve after every num_ops/npoints requests */
+        if (i + 1 >= next_point && s->npoints < npoints) {
+            s->points[s->npoints].op = i + 1;
+            s->points[s->npoints].bytes = live_bytes;
+            s->points[s->npoints].blocks = live_blocks;
+            s->npoints++;
+            next_point = (long)((double)(s->npoints + 1) * trace->num_ops /
+                                npoints);
+        }
+    }
+    for (i = 0; i < trace->num_ids; i++)
+        if (birth[i] >= 0)
+            s->unfreed++;
+
+    printf("%s: %d requests, %d ids, weight %d, suggested heap %d\n",
+           path, trace->num_ops, trace->num_ids, trace->weight,
+           trace->sugg_heapsize);
+    print_stats(s, top);
+    if (csv)
+        for (p = 0; p < s->npoints; p++)
+            fprintf(csv, "%s,%ld,%.0f,%ld\n", path, s->points[p].op,
+                    s->points[p].bytes, s->points[p].blocks);
+
+    free(s->sizes);
+    free(s);
+    free(birth);
+    free_trace(trace);
+}
+
+static int cmp_sizecount(const void *a, const void *b)
+{
+    const sizecount_t *x = a, *y = b;
+    if (x->count != y->count)
+        return (x->count < y->count) ? 1 : -1;
+    return (x->size > y->size) - (x->size < y->size);
+}
+
+/*
+ * life_percentile - Lower bound of the lifetime bucket holding
+ *     fraction q of the freed blocks
+ */
+static unsigned long life_percentile(stats_t *s, double q)
+{
+    unsigned long seen = 0;
+    int b;
+
+    for (b = 0; b < NOCTAVES * SUBBUCKETS; b++) {
+        seen += s->life[b];
+        if (seen >= q * s->nlife)
+            return life_bucket_lo(b);
+    }
+    return 0;
+}
+
+/*
+ * print_stats - Print the profile of one trace
+ */
+static void print_stats(stats_t *s, int top)
+{
+    long requests = s->allocs + s->reallocs;
+    unsigned long i, n, seen;
+    int o, b;
+
+    printf("  %ld mallocs, %ld reallocs, %ld frees; %.0f bytes requested, "
+           "mean %.1f\n", s->allocs, s->reallocs, s->frees,
+           s->bytes_requested, requests ? s->bytes_requested / requests : 0);
+    printf("  peak live: %.0f bytes (at request %ld), %ld blocks\n",
+           s->peak_bytes, s->peak_op + 1, s->peak_blocks);
+
+    printf("  request sizes:\n");
+    printf("  %21s %10s %7s %7s\n", "bytes", "requests", "%reqs", "%bytes");
+    for (o = 0; o < NOCTAVES; o++) {
+        if (s->size_count[o] == 0)
+            continue;
+        printf("  %10lu - %-8lu %10lu %6.1f%% %6.1f%%\n",
+               o ? 1UL << o : 0, (2UL << o) - 1, s->size_count[o],
+               100.0 * s->size_count[o] / requests,
+               100.0 * s->size_bytes[o] / s->bytes_requested);
+    }
+
+    /* Gather the used slots of the size table and sort by count */
+    for (i = 0, n = 0; i < s->size_slots; i++)
+        if (s->sizes[i].count)
+            s->sizes[n++] = s->sizes[i];
+    qsort(s->sizes, n, sizeof(sizecount_t), cmp_sizecount);
+    printf("  %lu distinct sizes; most common:", n);
+    for (i = 0, seen = 0; i < n && (int)i < top; i++) {
+        printf("%s %u (%.1f%%)", i ? "," : "", s->sizes[i].size,
+               100.0 * s->sizes[i].count / requests);
+        seen += s->sizes[i].count;
+    }
+    printf("\n  top %lu sizes cover %.1f%% of requests\n", i,
+           requests ? 100.0 * seen / requests : 0);
+
+    if (s->nlife) {
+        printf("  lifetimes (requests from malloc to free): mean %.1f, "
+               "p50 %lu, p90 %lu, p99 %lu; %ld never freed\n",
+               s->total_life / s->nlife, life_percentile(s, 0.50),
+               life_percentile(s, 0.90), life_percentile(s, 0.99),
+               s->unfreed);
+        printf("  %21s %10s %7s\n", "lifetime", "blocks", "%");
+        for (o = 0; o < NOCTAVES; o++) {
+            for (b = 0, n = 0; b < NOCTAVES * SUBBUCKETS; b++)
+                if (s->life[b] && octave(life_bucket_lo(b)) == o)
+                    n += s->life[b];
+            if (n)
+                printf("  %10lu - %-8lu %10lu %6.1f%%\n",
+                       o ? 1UL << o : 0, (2UL << o) - 1, n,
+                       100.0 * n / s->nlife);
+        }
+    }
+
+    for (b = 0, n = 0; b < NRATIOS; b++)
+        n += s->ratio[b];
+    if (n) {
+        printf("  realloc new/old size: geometric mean %.2f;",
+               exp(s->log_ratio / n));
+        for (b = 0; b < NRATIOS; b++)
+            printf(" %s %.1f%%%s", ratio_names[b], 100.0 * s->ratio[b] / n,
+                   b < NRATIOS - 1 ? "," : "\n");
+    }
+
+    printf("  live curve:\n");
+    printf("  %12s %14s %10s\n", "request", "live bytes", "blocks");
+    for (i = 0; i < (unsigned long)s->npoints; i++)
+        printf("  %12ld %14.0f %10ld\n", s->points[i].op,
+               s->points[i].bytes, s->points[i].blocks);
+    printf("\n");
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmtrace [-h] [-n <points>] [-t <sizes>] "
+            "[-c <file>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c <file>  Also write the live curves as CSV.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <n>     Points on the live curve (default 20).\n");
+    fprintf(stderr, "\t-t <n>     Most common sizes to list (default 10).\n");
+}
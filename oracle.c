@@ -0,0 +1,433 @@
+/*
+ * oracle.c - Offline placement of a trace's blocks (see oracle.h)
+ *
+ * Each block is a rectangle: its lifetime, from the request that
+ * allocates it to the one that frees it, by its size. A realloc ends
+ * one rectangle and starts another, which may reuse the same addresses.
+ * Placing rectangles at the lowest addresses that don't collide with
+ * any block alive at the same time is the dynamic storage allocation
+ * problem, which is NP-hard, so a few greedy orders are tried and the
+ * best is kept:
+ *
+ *   size:  largest blocks first, ties broken by longer lifetime
+ *   area:  largest size x lifetime first
+ *   time:  in allocation order, as an online first-fit allocator would
+ *
+ * Each block goes at the lowest gap among the already placed blocks
+ * that overlap it in time. In the time order these are just the blocks
+ * still alive, kept in one set as the requests are swept through. In
+ * the others they are found in a segment tree over the requests whose
+ * nodes keep the placed addresses merged into runs, and in the blocks
+ * alive at a few checkpoints, so the gap search jumps over whole packed
+ * runs rather than walking every block placed so far.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "oracle.h"
+
+/* One rectangle to place */
+typedef struct {
+    int start;       /* request that allocates it */
+    int end;         /* request that frees it (num_ops if never) */
+    size_t size;     /* payload rounded up to the alignment */
+    size_t offset;   /* placed address */
+} oblock_t;
+
+static int cmp_size(const void *a, const void *b)
+{
+    const oblock_t *x = a, *y = b;
+    if (x->size != y->size)
+        return (x->size < y->size) ? 1 : -1;
+    return (y->end - y->start) - (x->end - x->start);
+}
+
+static int cmp_area(const void *a, const void *b)
+{
+    const oblock_t *x = a, *y = b;
+    double ax = (double)x->size * (x->end - x->start);
+    double ay = (double)y->size * (y->end - y->start);
+    if (ax != ay)
+        return (ax < ay) ? 1 : -1;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+static int cmp_start(const void *a, const void *b)
+{
+    const oblock_t *x = a, *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+/* A sorted array of disjoint, non-touching address ranges [lo, hi) */
+typedef struct {
+    size_t (*r)[2];
+    int n, cap;
+} runs_t;
+
+/*
+ * One node of a segment tree over the requests. cover holds the
+ * addresses of the blocks alive for the whole of the node's requests,
+ * any those of the blocks alive for any of them.
+ */
+typedef struct {
+    runs_t cover, any;
+} otime_t;
+
+/* A set of runs in the way of a gap search, by where its next run starts */
+typedef struct {
+    size_t lo;     /* start of the run it has got to */
+    int cur;       /* index of that run */
+    runs_t *rs;
+} oset_t;
+
+/*
+ * What the placements are searched in: the segment tree, and the
+ * addresses of the blocks alive at every check'th request
+ */
+typedef struct {
+    otime_t *tree;
+    runs_t *live;
+    int num_ops, check;
+} oindex_t;
+
+/* At most four sets per level of the tree, and the checkpoints */
+#define MAXCHECKS 128
+#define MAXSETS   (4 * 32 + MAXCHECKS + 1)
+
+/*
+ * first_after - Index of the first run in rs ending after addr, which
+ *     is no lower than lo. Gallops up from lo, since a gap search is
+ *     usually only a little past where it last looked at rs.
+ */
+static int first_after(runs_t *rs, int lo, size_t addr)
+{
+    int step = 1, hi, mid;
+
+    if (lo >= rs->n || rs->r[lo][1] > addr)
+        return lo;
+    while (lo + step < rs->n && rs->r[lo + step][1] <= addr) {
+        lo += step;
+        step *= 2;
+    }
+    hi = (lo + step < rs->n) ? lo + step : rs->n;
+    lo++;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (rs->r[mid][1] > addr)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+/* runs_add - Add [lo, hi) to rs, merging the runs it overlaps or touches */
+static void runs_add(runs_t *rs, size_t lo, size_t hi)
+{
+    int i = first_after(rs, 0, lo ? lo - 1 : 0), j;
+
+    for (j = i; j < rs->n && rs->r[j][0] <= hi; j++)
+        ;
+    if (j > i) {
+        if (rs->r[i][0] < lo)
+            lo = rs->r[i][0];
+        if (rs->r[j-1][1] > hi)
+            hi = rs->r[j-1][1];
+    }
+    else if (rs->n == rs->cap) {
+        rs->cap = rs->cap ? 2 * rs->cap : 4;
+        if ((rs->r = realloc(rs->r, rs->cap * sizeof(rs->r[0]))) == NULL) {
+            printf("realloc failed in runs_add\n");
+            exit(1);
+        }
+    }
+    memmove(&rs->r[i+1], &rs->r[j], (rs->n - j) * sizeof(rs->r[0]));
+    rs->n += i + 1 - j;
+    rs->r[i][0] = lo;
+    rs->r[i][1] = hi;
+}
+
+/*
+ * runs_sub - Take [lo, hi) out of rs, which must hold it within one
+ *     run
+ */
+static void runs_sub(runs_t *rs, size_t lo, size_t hi)
+{
+    int i = first_after(rs, 0, lo), keep;
+    size_t rlo = rs->r[i][0], rhi = rs->r[i][1];
+
+    keep = (rlo < lo) + (hi < rhi);
+    if (keep == 2 && rs->n == rs->cap) {
+        rs->cap = 2 * rs->cap;
+        if ((rs->r = realloc(rs->r, rs->cap * sizeof(rs->r[0]))) == NULL) {
+            printf("realloc failed in runs_sub\n");
+            exit(1);
+        }
+    }
+    memmove(&rs->r[i+keep], &rs->r[i+1], (rs->n - i - 1) * sizeof(rs->r[0]));
+    rs->n += keep - 1;
+    if (rlo < lo) {
+        rs->r[i][0] = rlo;
+        rs->r[i++][1] = lo;
+    }
+    if (hi < rhi) {
+        rs->r[i][0] = hi;
+        rs->r[i][1] = rhi;
+    }
+}
+
+/* tree_add - Record block b in node x, which spans requests [l, r) */
+static void tree_add(otime_t *tree, int x, int l, int r, oblock_t *b)
+{
+    int m = (l + r) / 2;
+
+    runs_add(&tree[x].any, b->offset, b->offset + b->size);
+    if (b->start <= l && r <= b->end) {
+        runs_add(&tree[x].cover, b->offset, b->offset + b->size);
+        return;
+    }
+    if (b->start < m)
+        tree_add(tree, 2*x, l, m, b);
+    if (m < b->end)
+        tree_add(tree, 2*x + 1, m, r, b);
+}
+
+/*
+ * tree_runs - Add to sets those in node x, which spans requests [l, r),
+ *     that hold blocks alive at the same time as b, returning the new
+ *     number of sets
+ */
+static int tree_runs(otime_t *tree, int x, int l, int r, oblock_t *b,
+                     oset_t *sets, int nsets)
+{
+    int m = (l + r) / 2;
+
+    if (b->start <= l && r <= b->end) {
+        if (tree[x].any.n)
+            sets[nsets++].rs = &tree[x].any;
+        return nsets;
+    }
+    if (tree[x].cover.n)
+        sets[nsets++].rs = &tree[x].cover;
+    if (b->start < m)
+        nsets = tree_runs(tree, 2*x, l, m, b, sets, nsets);
+    if (m < b->end)
+        nsets = tree_runs(tree, 2*x + 1, m, r, b, sets, nsets);
+    return nsets;
+}
+
+/*
+ * sift_down - Restore the heap of sets at heap[i], which is ordered by
+ *     where the next run of each starts
+ */
+static void sift_down(oset_t *heap, int n, int i)
+{
+    oset_t x = heap[i];
+    int c;
+
+    while ((c = 2*i + 1) < n) {
+        if (c + 1 < n && heap[c+1].lo < heap[c].lo)
+            c++;
+        if (heap[c].lo >= x.lo)
+            break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = x;
+}
+
+/*
+ * place - Find the lowest address for b that misses every block placed
+ *     so far that is alive at the same time, and record it there
+ */
+static void place(oindex_t *ix, oblock_t *b)
+{
+    oset_t sets[MAXSETS];
+    int nsets, j, k;
+    size_t cand = 0;
+    runs_t *rs;
+
+    /*
+     * The blocks alive at a checkpoint within b's lifetime all collide
+     * with it. They are in the tree's sets too, but packed together in
+     * one set, so the search gets over them in one step rather than a
+     * step for each piece of them that is in a different set.
+     */
+    nsets = tree_runs(ix->tree, 1, 0, ix->num_ops, b, sets, 0);
+    for (j = (b->start + ix->check - 1) / ix->check;
+         j * ix->check < b->end; j++)
+        if (ix->live[j].n)
+            sets[nsets++].rs = &ix->live[j];
+
+    /* Walk the runs in the way in address order until a hole fits */
+    for (j = 0; j < nsets; j++) {
+        sets[j].cur = 0;
+        sets[j].lo = sets[j].rs->r[0][0];
+    }
+    for (j = nsets / 2 - 1; j >= 0; j--)
+        sift_down(sets, nsets, j);
+    while (nsets > 0 && sets[0].lo < cand + b->size) {
+        rs = sets[0].rs;
+        if (rs->r[sets[0].cur][1] > cand)
+            cand = rs->r[sets[0].cur][1];
+        if ((k = first_after(rs, sets[0].cur, cand)) < rs->n) {
+            sets[0].cur = k;
+            sets[0].lo = rs->r[k][0];
+        }
+        else
+            sets[0] = sets[--nsets];
+        sift_down(sets, nsets, 0);
+    }
+    b->offset = cand;
+
+    tree_add(ix->tree, 1, 0, ix->num_ops, b);
+    for (j = (b->start + ix->check - 1) / ix->check;
+         j * ix->check < b->end; j++)
+        runs_add(&ix->live[j], b->offset, b->offset + b->size);
+}
+
+static int cmp_end(const void *a, const void *b)
+{
+    const oblock_t *x = *(oblock_t * const *)a, *y = *(oblock_t * const *)b;
+    return (x->end > y->end) - (x->end < y->end);
+}
+
+/*
+ * place_sweep - Place blocks, sorted by start, in that order. The
+ *     blocks placed before b that are alive at the same time are just
+ *     those still alive when it starts, so rather than searching the
+ *     tree, sweep through the requests keeping the addresses of the
+ *     live blocks in one set of runs. byend has room for a pointer
+ *     to each block.
+ */
+static void place_sweep(oblock_t *blocks, int n, runs_t *live,
+                        oblock_t **byend)
+{
+    int i, j, dead = 0;
+    size_t cand;
+
+    for (i = 0; i < n; i++)
+        byend[i] = &blocks[i];
+    qsort(byend, n, sizeof(oblock_t *), cmp_end);
+    for (i = 0; i < n; i++) {
+        for (; byend[dead]->end <= blocks[i].start; dead++)
+            if (byend[dead]->size > 0)
+                runs_sub(live, byend[dead]->offset,
+                         byend[dead]->offset + byend[dead]->size);
+        cand = 0;
+        if (blocks[i].size > 0) {   /* else it collides with nothing */
+            for (j = 0; j < live->n && live->r[j][0] < cand + blocks[i].size;
+                 j++)
+                cand = live->r[j][1];
+            runs_add(live, cand, cand + blocks[i].size);
+        }
+        blocks[i].offset = cand;
+    }
+}
+
+/*
+ * oracle_heapsize - Find the best of the greedy placements
+ */
+size_t oracle_heapsize(trace_t *trace, size_t align, size_t *peak)
+{
+    static int (*orders[])(const void *, const void *) = {
+        cmp_size, cmp_area, cmp_start
+    };
+    oblock_t *blocks;
+    oindex_t ix;
+    runs_t sweep = {NULL, 0, 0};   /* the live blocks, for the time order */
+    oblock_t **byend;              /* the blocks by when they're freed */
+    int *open;     /* the rectangle currently holding each id, or -1 */
+    int n = 0, i, k, index, nodes, nchecks;
+    size_t heap, best = 0, live = 0, max_live = 0;
+    double lifetimes = 0;
+    traceop_t *op;
+
+    if ((blocks = malloc(trace->num_ops * sizeof(oblock_t))) == NULL ||
+        (byend = malloc(trace->num_ops * sizeof(oblock_t *))) == NULL ||
+        (open = malloc(trace->num_ids * sizeof(int))) == NULL) {
+        printf("malloc failed in oracle_heapsize\n");
+        exit(1);
+    }
+    for (i = 0; i < trace->num_ids; i++)
+        open[i] = -1;
+
+    /* Cut the trace into rectangles */
+    for (i = 0; i < trace->num_ops; i++) {
+        op = &trace->ops[i];
+        index = op->index;
+        if (open[index] >= 0 && op->type != ALLOC) {
+            blocks[open[index]].end = i;
+            live -= blocks[open[index]].size;
+            open[index] = -1;
+        }
+        if (op->type == FREE)
+            continue;
+        blocks[n].start = i;
+        blocks[n].end = trace->num_ops;
+        blocks[n].size = ((op->size + align - 1) / align) * align;
+        open[index] = n++;
+        live += blocks[open[index]].size;
+        if (live > max_live)
+            max_live = live;
+    }
+    for (i = 0; i < n; i++)
+        lifetimes += blocks[i].end - blocks[i].start;
+
+    /*
+     * Space the checkpoints so that a block spans about four of them,
+     * which is as many copies of it as the checkpoints keep
+     */
+    ix.num_ops = trace->num_ops;
+    ix.check = (n > 0) ? (int)(lifetimes / n / 4) : 1;
+    if (ix.check < trace->num_ops / MAXCHECKS + 1)
+        ix.check = trace->num_ops / MAXCHECKS + 1;
+    nchecks = (trace->num_ops + ix.check - 1) / ix.check;
+    nodes = 4 * trace->num_ops + 4;
+    if ((ix.tree = calloc(nodes, sizeof(otime_t))) == NULL ||
+        (ix.live = calloc(nchecks + 1, sizeof(runs_t))) == NULL) {
+        printf("calloc failed in oracle_heapsize\n");
+        exit(1);
+    }
+
+    for (k = 0; k < (int)(sizeof(orders) / sizeof(orders[0])); k++) {
+        qsort(blocks, n, sizeof(oblock_t), orders[k]);
+        if (orders[k] == cmp_start)
+            place_sweep(blocks, n, &sweep, byend);
+        else
+            for (i = 0; i < n; i++) {
+                blocks[i].offset = 0;
+                if (blocks[i].size > 0)   /* else it collides with nothing */
+                    place(&ix, &blocks[i]);
+            }
+        heap = 0;
+        for (i = 0; i < n; i++)
+            if (blocks[i].offset + blocks[i].size > heap)
+                heap = blocks[i].offset + blocks[i].size;
+        if (k == 0 || heap < best)
+            best = heap;
+        for (i = 0; i < nodes; i++)
+            ix.tree[i].cover.n = ix.tree[i].any.n = 0;
+        for (i = 0; i < nchecks; i++)
+            ix.live[i].n = 0;
+        sweep.n = 0;
+    }
+
+    for (i = 0; i < nodes; i++) {
+        free(ix.tree[i].cover.r);
+        free(ix.tree[i].any.r);
+    }
+    for (i = 0; i < nchecks; i++)
+        free(ix.live[i].r);
+    free(ix.tree);
+    free(ix.live);
+    free(sweep.r);
+    free(byend);
+    free(blocks);
+    free(open);
+    if (peak)
+        *peak = max_live;
+    return best;
+}
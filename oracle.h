@@ -0,0 +1,14 @@
+/*
+ * oracle.h - Offline placement of a trace's blocks, as a practical
+ *     bound on the heap size a non-moving allocator could achieve
+ */
+#include <stddef.h>
+
+/*
+ * Heap bytes needed to place every block of the trace, each payload
+ * rounded up to align bytes, given every block's lifetime in advance.
+ * Block headers and other allocator metadata are not counted. If
+ * peak is not NULL, it gets the peak of the rounded live bytes, which
+ * no placement can beat.
+ */
+size_t oracle_heapsize(trace_t *trace, size_t align, size_t *peak);
@@ -0,0 +1,388 @@
+/*
+ * prof.c - Sampling profiler for the functions called by a test function
+ *
+ * While prof_run() is executing a test function, the ITIMER_PROF
+ * interval timer delivers a SIGPROF every PROF_USECS of CPU time. The
+ * handler records the interrupted program counter and the call stack
+ * beneath it in a preallocated buffer. Addresses are symbolized
+ * afterwards against the symbol table of the running executable, which
+ * includes static functions such as the helpers in mm.c, so no external
+ * profiling tools are needed.
+ *
+ * Attribution to small static functions is only as good as the
+ * compiler's inlining allows: the -Og mdriver build keeps them as
+ * separate functions, while mdriver.opt folds many of them into
+ * their callers.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <execinfo.h>
+#include <ucontext.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "prof.h"
+
+#define PROF_USECS    1000    /* sampling interval in usecs of CPU time */
+#define MAXPSAMPLES   100000  /* max samples kept between prof_resets */
+#define MAXDEPTH      32      /* max frames recorded per sample */
+
+/* One recorded call stack, innermost frame first */
+typedef struct {
+    int depth;
+    void *pc[MAXDEPTH];
+} psample_t;
+
+/* A function from the executable's symbol table */
+typedef struct {
+    unsigned long lo;  /* runtime address of the first instruction */
+    unsigned long hi;  /* one past the last */
+    char *name;
+} psym_t;
+
+/* Per-function totals for prof_print */
+typedef struct {
+    char *name;
+    int self;
+    int total;
+} pcount_t;
+
+static psample_t *psamples = NULL;
+static volatile int npsamples = 0;
+
+static psym_t *psyms = NULL;
+static int npsyms = -1;   /* -1 until the symbol table has been loaded */
+
+/*
+ * sample_pc - Return the program counter saved in the signal context
+ */
+static void *sample_pc(void *ctx)
+{
+    ucontext_t *uc = ctx;
+#if defined(__x86_64__)
+    return (void *)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+    return (void *)uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+    return (void *)uc->uc_mcontext.pc;
+#else
+    return NULL;
+#endif
+}
+
+/*
+ * sigprof_handler - Record the interrupted PC and the stack below it.
+ *     backtrace() also returns the handler's own frames and the signal
+ *     trampoline, so those are skipped by looking for the saved PC.
+ */
+static void sigprof_handler(int sig, siginfo_t *si, void *ctx)
+{
+    void *frames[MAXDEPTH + 4];
+    psample_t *s;
+    int n, i, j;
+
+    if (npsamples >= MAXPSAMPLES)
+        return;
+    s = &psamples[npsamples];
+    s->pc[0] = sample_pc(ctx);
+    n = backtrace(frames, MAXDEPTH + 4);
+    for (i = 0; i < n && frames[i] != s->pc[0]; i++)
+        ;
+    if (i == n) {
+        s->depth = 1;
+    }
+    else {
+        for (j = 1, i++; i < n && j < MAXDEPTH; i++, j++)
+            s->pc[j] = frames[i];
+        s->depth = j;
+    }
+    npsamples++;
+}
+
+/*
+ * prof_run - Run f(argp) for about secs seconds of CPU time with the
+ *     profiling timer armed. Returns the number of samples taken.
+ */
+int prof_run(prof_test_funct f, void *argp, double secs)
+{
+    struct sigaction sa, old_sa;
+    struct itimerval it, old_it;
+    void *dummy[1];
+    clock_t start;
+    int before = npsamples;
+
+    if (psamples == NULL &&
+        (psamples = malloc(MAXPSAMPLES * sizeof(psample_t))) == NULL) {
+        fprintf(stderr, "prof_run: malloc failed\n");
+        exit(1);
+    }
+
+    /* The first backtrace() call loads the unwinder, which must not
+       happen inside the signal handler */
+    backtrace(dummy, 1);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = sigprof_handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, &old_sa);
+
+    it.it_interval.tv_sec = 0;
+    it.it_interval.tv_usec = PROF_USECS;
+    it.it_value = it.it_interval;
+    setitimer(ITIMER_PROF, &it, &old_it);
+
+    start = clock();
+    do {
+        f(argp);
+    } while (clock() - start < secs * CLOCKS_PER_SEC);
+
+    setitimer(ITIMER_PROF, &old_it, NULL);
+    sigaction(SIGPROF, &old_sa, NULL);
+    return npsamples - before;
+}
+
+/*
+ * prof_reset - Discard the samples collected so far
+ */
+void prof_reset(void)
+{
+    npsamples = 0;
+}
+
+/*************************************************
+ * Symbolization against the executable's symtab
+ *************************************************/
+
+static int cmp_psym(const void *a, const void *b)
+{
+    const psym_t *x = a, *y = b;
+    return (x->lo > y->lo) - (x->lo < y->lo);
+}
+
+/*
+ * load_symbols - Read the function symbols from the ELF symbol table
+ *     of /proc/self/exe. The load bias of a position-independent
+ *     executable is found by locating prof_run itself.
+ */
+static void load_symbols(void)
+{
+    int fd, i, j, nsyms;
+    struct stat st;
+    char *map;
+    ElfW(Ehdr) *eh;
+    ElfW(Shdr) *sh;
+    ElfW(Sym) *sym;
+    char *strtab;
+    unsigned long bias = 0;
+
+    npsyms = 0;
+    if ((fd = open("/proc/self/exe", O_RDONLY)) < 0)
+        return;
+    if (fstat(fd, &st) < 0 ||
+        (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    close(fd);
+
+    eh = (ElfW(Ehdr) *)map;
+    if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0) {
+        munmap(map, st.st_size);
+        return;
+    }
+    sh = (ElfW(Shdr) *)(map + eh->e_shoff);
+    for (i = 0; i < eh->e_shnum; i++) {
+        if (sh[i].sh_type != SHT_SYMTAB)
+            continue;
+        sym = (ElfW(Sym) *)(map + sh[i].sh_offset);
+        nsyms = sh[i].sh_size / sizeof(ElfW(Sym));
+        strtab = map + sh[sh[i].sh_link].sh_offset;
+        if ((psyms = malloc(nsyms * sizeof(psym_t))) == NULL)
+            break;
+        for (j = 0; j < nsyms; j++) {
+            if (ELF64_ST_TYPE(sym[j].st_info) != STT_FUNC ||
+                sym[j].st_value == 0)
+                continue;
+            if (!strcmp(strtab + sym[j].st_name, "prof_run"))
+                bias = (unsigned long)prof_run - sym[j].st_value;
+            psyms[npsyms].lo = sym[j].st_value;
+            psyms[npsyms].hi = sym[j].st_value +
+                (sym[j].st_size ? sym[j].st_size : 1);
+            psyms[npsyms].name = strdup(strtab + sym[j].st_name);
+            npsyms++;
+        }
+        break;
+    }
+    munmap(map, st.st_size);
+
+    for (i = 0; i < npsyms; i++) {
+        psyms[i].lo += bias;
+        psyms[i].hi += bias;
+    }
+    qsort(psyms, npsyms, sizeof(psym_t), cmp_psym);
+}
+
+/*
+ * symbolize - Return the name of the function containing pc. Addresses
+ *     outside the executable fall back to the dynamic symbols of shared
+ *     libraries, and then to the library name.
+ */
+static char *symbolize(void *pc)
+{
+    unsigned long addr = (unsigned long)pc;
+    int lo = 0, hi, mid;
+    Dl_info info;
+
+    if (npsyms < 0)
+        load_symbols();
+    hi = npsyms - 1;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (addr < psyms[mid].lo)
+            hi = mid - 1;
+        else if (addr >= psyms[mid].hi)
+            lo = mid + 1;
+        else
+            return psyms[mid].name;
+    }
+    if (dladdr(pc, &info)) {
+        if (info.dli_sname)
+            return (char *)info.dli_sname;
+        if (info.dli_fname) {
+            char *slash = strrchr(info.dli_fname, '/');
+            return slash ? slash + 1 : (char *)info.dli_fname;
+        }
+    }
+    return "??";
+}
+
+/*****************
+ * Reporting
+ *****************/
+
+/*
+ * frame_addr - Address to symbolize for frame j of sample s. Outer
+ *     frames hold return addresses, which may point just past the end
+ *     of the calling function, so look up the call instruction instead.
+ */
+static void *frame_addr(psample_t *s, int j)
+{
+    return (char *)s->pc[j] - (j > 0);
+}
+
+static int cmp_pcount(const void *a, const void *b)
+{
+    const pcount_t *x = a, *y = b;
+    return (y->self != x->self) ? y->self - x->self : y->total - x->total;
+}
+
+static int cmp_string(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static pcount_t *counts = NULL;  /* per-function totals for prof_print */
+static int ncounts = 0;
+static int maxcounts = 0;
+
+/*
+ * find_count - Return the counter for name, adding it if needed
+ */
+static pcount_t *find_count(char *name)
+{
+    int i;
+
+    for (i = 0; i < ncounts; i++)
+        if (counts[i].name == name || !strcmp(counts[i].name, name))
+            return &counts[i];
+    if (ncounts == maxcounts) {
+        maxcounts = maxcounts ? 2 * maxcounts : 64;
+        if ((counts = realloc(counts, maxcounts * sizeof(pcount_t))) == NULL) {
+            fprintf(stderr, "find_count: realloc failed\n");
+            exit(1);
+        }
+    }
+    counts[ncounts].name = name;
+    counts[ncounts].self = counts[ncounts].total = 0;
+    return &counts[ncounts++];
+}
+
+/*
+ * prof_print - Print the top functions by self samples (the function
+ *     the PC was in) along with their total samples (the function was
+ *     anywhere on the stack)
+ */
+void prof_print(int top)
+{
+    char *names[MAXDEPTH];
+    int i, j, k;
+
+    if (npsamples == 0) {
+        printf("  no samples\n");
+        return;
+    }
+    ncounts = 0;
+    for (i = 0; i < npsamples; i++) {
+        for (j = 0; j < psamples[i].depth; j++) {
+            names[j] = symbolize(frame_addr(&psamples[i], j));
+
+            /* count recursive functions once per sample */
+            for (k = 0; k < j && strcmp(names[k], names[j]); k++)
+                ;
+            if (k == j)
+                find_count(names[j])->total++;
+        }
+        find_count(names[0])->self++;
+    }
+    qsort(counts, ncounts, sizeof(pcount_t), cmp_pcount);
+
+    printf("%7s%7s  %s\n", "self", "total", "function");
+    for (i = 0; i < ncounts && i < top && counts[i].self > 0; i++)
+        printf("%6.1f%%%6.1f%%  %s\n",
+               100.0 * counts[i].self / npsamples,
+               100.0 * counts[i].total / npsamples,
+               counts[i].name);
+}
+
+/*
+ * prof_write_folded - Write one line per distinct stack, outermost
+ *     frame first, in the format read by flamegraph.pl
+ */
+void prof_write_folded(FILE *fp, char *label)
+{
+    char **lines;
+    char line[MAXDEPTH * 64];
+    int i, j, n, len;
+
+    if ((lines = malloc(npsamples * sizeof(char *))) == NULL) {
+        fprintf(stderr, "prof_write_folded: malloc failed\n");
+        exit(1);
+    }
+    for (i = 0; i < npsamples; i++) {
+        len = snprintf(line, sizeof(line), "%s", label);
+        for (j = psamples[i].depth - 1; j >= 0; j--)
+            len += snprintf(line + len, sizeof(line) - len, ";%s",
+                            symbolize(frame_addr(&psamples[i], j)));
+        lines[i] = strdup(line);
+    }
+    qsort(lines, npsamples, sizeof(char *), cmp_string);
+    for (i = 0; i < npsamples; i = j) {
+        for (j = i, n = 0; j < npsamples && !strcmp(lines[i], lines[j]); j++)
+            n++;
+        fprintf(fp, "%s %d\n", lines[i], n);
+    }
+    for (i = 0; i < npsamples; i++)
+        free(lines[i]);
+    free(lines);
+}
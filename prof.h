@@ -0,0 +1,19 @@
+/*
+ * Sampling profiler based on the ITIMER_PROF interval timer
+ */
+typedef void (*prof_test_funct)(void *);
+
+/* Run f(argp) repeatedly for about secs seconds of CPU time, sampling
+   the interrupted call stack on every SIGPROF. Returns the number of
+   samples taken. Samples accumulate until prof_reset is called. */
+int prof_run(prof_test_funct f, void *argp, double secs);
+
+/* Discard the samples collected so far */
+void prof_reset(void);
+
+/* Print the top functions by self time, with their inclusive time */
+void prof_print(int top);
+
+/* Append the samples as folded stacks (one "a;b;c count" line per
+   distinct stack), each stack prefixed with label */
+void prof_write_folded(FILE *fp, char *label);
@@ -0,0 +1,79 @@
+/*
+ * sizeclasses.h - Size classes for mm.c, generated by mkclasses from
+ * traces/amptjp-bal.rep traces/binary-bal.rep traces/binary2-bal.rep
+ * traces/cccp-bal.rep traces/coalescing-bal.rep traces/cp-decl-bal.rep
+ * traces/expr-bal.rep traces/random-bal.rep traces/random2-bal.rep
+ * traces/realloc-bal.rep traces/realloc2-bal.rep traces/short1-bal.rep
+ * traces/short2-bal.rep
+ *
+ * Don't edit; rerun "make classes". Rounding the 46233 blocks of up to
+ * 8192 bytes to the tops of their classes would waste 0.7% of their
+ * bytes; 14764 larger blocks are in the last class.
+ */
+#ifndef __SIZECLASSES_H_
+#define __SIZECLASSES_H_
+
+#define SC_NCLASSES 24   /* the last is for blocks over SC_MAXSIZE */
+#define SC_GRAIN    16   /* block sizes are multiples of this */
+#define SC_MAXSIZE  8192 /* largest block size in sc_index */
+
+/* Largest block size in each class (0: no limit) */
+static const unsigned sc_size[SC_NCLASSES] = {
+    32, 96, 128, 144, 176, 464, 528, 1136,
+    1680, 2240, 2944, 3600, 4096, 4112, 4576, 5008,
+    5504, 5984, 6496, 6944, 7344, 7728, 8192, 0
+};
+
+/* Pages per slab and blocks per slab, for each class */
+static const unsigned sc_slab_pages[SC_NCLASSES] = {
+    1, 1, 1, 1, 1, 1, 1, 2,
+    3, 3, 3, 1, 1, 8, 5, 4,
+    3, 3, 5, 7, 2, 2, 2, 0
+};
+static const unsigned sc_slab_blocks[SC_NCLASSES] = {
+    128, 42, 32, 28, 23, 8, 7, 7,
+    7, 5, 4, 1, 1, 7, 4, 3,
+    2, 2, 3, 4, 1, 1, 1, 0
+};
+
+/* Class of each block size up to SC_MAXSIZE, by size / SC_GRAIN */
+static const unsigned char sc_index[SC_MAXSIZE / SC_GRAIN + 1] = {
+    0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 4, 4, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 6, 6,
+    6, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+    9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 10, 10, 10,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    10, 10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+    11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+    11, 11, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+    12, 13, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17,
+    17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17,
+    17, 17, 17, 17, 17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18, 18,
+    18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18,
+    18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19, 19, 19, 19,
+    19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19,
+    19, 19, 19, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,
+    20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 21, 21, 21, 21,
+    21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+    21, 21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+    22
+};
+
+#define SC_CLASS(size) ((size) <= SC_MAXSIZE ? sc_index[(size) / SC_GRAIN] : \
+                        SC_NCLASSES - 1)
+
+#endif /* __SIZECLASSES_H_ */
@@ -0,0 +1,561 @@
+/*
+ * trace.c - Reading malloc trace files into memory (see trace.h)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+#include "tracefmt.h"
+
+#define MAXLINE     1024 /* max string size */
+
+#define PARSE_MAXTHREADS 16         /* most threads parsing one trace */
+#define PARSE_MINCHUNK   (4 << 20)  /* fewest bytes worth a thread */
+
+static void unix_error(char *msg);
+
+/*
+ * read_trace_bin - read the rest of a binary trace file, after the magic
+ *     number, into trace
+ */
+static void read_trace_bin(trace_t *trace, FILE *tracefile, char *path)
+{
+    trace_bin_header_t hdr;
+    trace_bin_op_t op;
+    int i;
+
+    hdr.magic = TRACE_BIN_MAGIC;
+    if (fread(&hdr.record_size, sizeof(hdr) - sizeof(hdr.magic), 1, 
+              tracefile) != 1 || hdr.record_size != sizeof(trace_bin_op_t) ||
+        hdr.num_ids > INT_MAX || hdr.num_ops > INT_MAX ||
+        hdr.sugg_heapsize > INT_MAX || hdr.weight > INT_MAX) {
+        printf("Bad binary trace header in %s\n", path);
+        exit(1);
+    }
+    trace->sugg_heapsize = hdr.sugg_heapsize;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;
+
+    if ((trace->ops = 
+         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL ||
+        (trace->blocks = 
+         (char **)malloc(trace->num_ids * sizeof(char *))) == NULL ||
+        (trace->block_sizes = 
+         (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+        unix_error("malloc failed in read_trace_bin");
+
+    for (i = 0; i < trace->num_ops; i++) {
+        if (fread(&op, sizeof(op), 1, tracefile) != 1) {
+            printf("Binary trace %s ends after %d of %d requests\n", 
+                   path, i, trace->num_ops);
+            exit(1);
+        }
+        if (op.index >= hdr.num_ids || op.size > INT_MAX) {
+            printf("Bad request %d in binary trace %s\n", i, path);
+            exit(1);
+        }
+        switch (op.type) {
+        case 'a': trace->ops[i].type = ALLOC; break;
+        case 'r': trace->ops[i].type = REALLOC; break;
+        case 'f': trace->ops[i].type = FREE; break;
+        default:
+            printf("Bogus type character (%c) in tracefile %s\n", 
+                   op.type, path);
+            exit(1);
+        }
+        trace->ops[i].index = op.index;
+        trace->ops[i].size = op.size;
+    }
+}
+
+/*
+ * The text parser. The file is mapped into memory and its request
+ * lines are cut into chunks that end at newlines, which threads parse
+ * in parallel into arrays of their own; the arrays are then copied in
+ * order into the trace. Only traces of several megabytes are split.
+ */
+
+/* A run of whole request lines and what was parsed from it */
+typedef struct {
+    const char *start, *end;  /* the lines; end[-1] is a newline */
+    const char *file_start;   /* where start is in the file */
+    int num_ids;              /* ids must be below this */
+    traceop_t *ops;           /* the requests... */
+    long nops;                /* ...and how many */
+    const char *err_pos;      /* first bad line, or NULL */
+    const char *err_msg;
+} chunk_t;
+
+/*
+ * parse_uint - Parse an unsigned decimal no larger than INT_MAX after
+ *     any blanks (not newlines) at *pp, advancing *pp past it. Returns
+ *     -1 if there is none. The caller guarantees that a newline
+ *     follows, so the digit loop needs no bounds check.
+ */
+static long parse_uint(const char **pp)
+{
+    const char *p = *pp;
+    unsigned long v = 0;
+    unsigned d;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if ((unsigned)(*p - '0') > 9)
+        return -1;
+    while ((d = (unsigned)(*p - '0')) <= 9 && v <= INT_MAX) {
+        v = v * 10 + d;
+        p++;
+    }
+    if (v > INT_MAX)
+        return -1;
+    *pp = p;
+    return (long)v;
+}
+
+/*
+ * parse_chunk - Parse the request lines of a chunk. Blank lines are
+ *     skipped. Stops at the first bad line, recording where it is.
+ */
+static void *parse_chunk(void *arg)
+{
+    chunk_t *c = (chunk_t *)arg;
+    const char *p = c->start, *end = c->end;
+    const char *nl;
+    traceop_t *op;
+    long index, size, cap = 1;
+    char type;
+
+    /* Every request ends its line, so there are at most as many
+       requests as newlines (the chunk ends with one) */
+    for (nl = p; nl < end && (nl = memchr(nl, '\n', end - nl)) != NULL; nl++)
+        cap++;
+    if ((c->ops = (traceop_t *)malloc(cap * sizeof(traceop_t))) == NULL) {
+        c->err_pos = p;
+        c->err_msg = "out of memory";
+        return NULL;
+    }
+    c->nops = 0;
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' ||
+                           *p == '\n'))
+            p++;
+        if (p == end)
+            break;
+        if (c->nops == cap) {
+            c->err_msg = "more requests than lines";
+            break;
+        }
+        op = &c->ops[c->nops];
+        type = *p++;
+        index = parse_uint(&p);
+        size = 0;
+        if (type == 'a' || type == 'r')
+            size = parse_uint(&p);
+        else if (type == 'f') {
+            if (*p == 'd')   /* "f %ud" was once the format */
+                p++;
+        }
+        else {
+            c->err_msg = "unknown request type";
+            break;
+        }
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+            p++;
+        if (index < 0 || size < 0 || *p != '\n') {
+            c->err_msg = "malformed request";
+            break;
+        }
+        if (index >= c->num_ids) {
+            c->err_msg = "block id not below the header's number of ids";
+            break;
+        }
+        op->type = (type == 'a') ? ALLOC : (type == 'r') ? REALLOC : FREE;
+        op->index = (int)index;
+        op->size = (int)size;
+        c->nops++;
+    }
+    if (p < end) {
+        while (p > c->start && p[-1] != '\n')
+            p--;
+        c->err_pos = p;
+    }
+    return NULL;
+}
+
+/*
+ * line_number - The line of the file (from 1) that pos is on
+ */
+static long line_number(const char *file, const char *pos)
+{
+    const char *p;
+    long line = 1;
+
+    for (p = file; p < pos && (p = memchr(p, '\n', pos - p)) != NULL; p++)
+        line++;
+    return line;
+}
+
+/*
+ * read_trace_text - parse a .rep file, mapped at map, into trace
+ */
+static void read_trace_text(trace_t *trace, const char *map, size_t len,
+                            char *path)
+{
+    chunk_t chunks[PARSE_MAXTHREADS + 1];
+    pthread_t threads[PARSE_MAXTHREADS];
+    int started[PARSE_MAXTHREADS];
+    long header[4], nops, line;
+    const char *p = map, *end = map + len, *body, *last, *next;
+    char tail[MAXLINE + 1];
+    int i, nchunks, nthreads;
+
+    /* The header is four numbers, one per line */
+    for (i = 0; i < 4; i++) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' ||
+                           *p == '\n'))
+            p++;
+        next = memchr(p, '\n', end - p);
+        if (next == NULL || (header[i] = parse_uint(&p)) < 0) {
+            printf("Bad header (line %d) in tracefile %s\n", i + 1, path);
+            exit(1);
+        }
+    }
+    trace->sugg_heapsize = header[0];
+    trace->num_ids = header[1];
+    trace->num_ops = header[2];
+    trace->weight = header[3];
+    body = p;
+
+    /* The last newline; anything after it is a line of its own */
+    for (last = end; last > body && last[-1] != '\n'; last--)
+        ;
+
+    /* Cut the whole lines into chunks, one per thread */
+    nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > PARSE_MAXTHREADS)
+        nthreads = PARSE_MAXTHREADS;
+    if (nthreads > (last - body) / PARSE_MINCHUNK)
+        nthreads = (last - body) / PARSE_MINCHUNK;
+    if (nthreads < 1)
+        nthreads = 1;
+    for (i = 0, p = body; i < nthreads; i++) {
+        next = (i == nthreads - 1) ? last : 
+            body + (last - body) * (i + 1) / nthreads;
+        if (next < p)
+            next = p;
+        while (next < last && next[-1] != '\n')
+            next++;
+        chunks[i].start = chunks[i].file_start = p;
+        chunks[i].end = next;
+        p = next;
+    }
+    nchunks = nthreads;
+
+    /* Give the last line a newline if the file doesn't end with one */
+    if (last < end) {
+        if (end - last > MAXLINE) {
+            printf("Line %ld of tracefile %s is too long\n",
+                   line_number(map, last), path);
+            exit(1);
+        }
+        memcpy(tail, last, end - last);
+        tail[end - last] = '\n';
+        chunks[nchunks].start = tail;
+        chunks[nchunks].end = tail + (end - last) + 1;
+        chunks[nchunks].file_start = last;
+        nchunks++;
+    }
+
+    /* Parse the chunks, all but the first on threads of their own */
+    for (i = 0; i < nchunks; i++) {
+        chunks[i].num_ids = trace->num_ids;
+        chunks[i].err_pos = NULL;
+        chunks[i].ops = NULL;
+        chunks[i].nops = 0;
+    }
+    for (i = 1; i < nthreads; i++)
+        started[i] = !pthread_create(&threads[i], NULL, parse_chunk, 
+                                     &chunks[i]);
+    parse_chunk(&chunks[0]);
+    for (i = nthreads; i < nchunks; i++)
+        parse_chunk(&chunks[i]);
+    for (i = 1; i < nthreads; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            parse_chunk(&chunks[i]);
+    }
+
+    /* Report the first bad line */
+    for (i = 0, nops = 0; i < nchunks; i++) {
+        if (chunks[i].err_pos) {
+            line = line_number(map, chunks[i].file_start + 
+                               (chunks[i].err_pos - chunks[i].start));
+            printf("Bad request at line %ld of tracefile %s: %s\n",
+                   line, path, chunks[i].err_msg);
+            exit(1);
+        }
+        nops += chunks[i].nops;
+    }
+    if (nops != trace->num_ops) {
+        printf("Tracefile %s has %ld requests, but its header says %d\n",
+               path, nops, trace->num_ops);
+        exit(1);
+    }
+
+    /* Gather the chunks' requests in order */
+    if ((trace->ops = 
+         (traceop_t *)malloc((nops ? nops : 1) * sizeof(traceop_t))) == NULL ||
+        (trace->blocks = 
+         (char **)malloc((trace->num_ids ? trace->num_ids : 1) * 
+                         sizeof(char *))) == NULL ||
+        (trace->block_sizes = 
+         (size_t *)malloc((trace->num_ids ? trace->num_ids : 1) *
+                          sizeof(size_t))) == NULL)
+        unix_error("malloc failed in read_trace_text");
+    for (i = 0, nops = 0; i < nchunks; i++) {
+        memcpy(trace->ops + nops, chunks[i].ops, 
+               chunks[i].nops * sizeof(traceop_t));
+        nops += chunks[i].nops;
+        free(chunks[i].ops);
+    }
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename, int verbose)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char path[MAXLINE];
+    struct stat st;
+    uint32_t magic;
+    void *map;
+    int fd;
+
+    if (verbose > 1)
+        printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+        unix_error("malloc 1 failed in read_trance");
+	
+    if (strlen(tracedir) + strlen(filename) >= MAXLINE) {
+        printf("Trace path %s%s is too long\n", tracedir, filename);
+        exit(1);
+    }
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        printf("Could not open %s in read_trace: %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    /* Binary traces (see tracefmt.h) start with a magic number */
+    if (read(fd, &magic, sizeof(magic)) == sizeof(magic) &&
+        magic == TRACE_BIN_MAGIC) {
+        if ((tracefile = fdopen(fd, "r")) == NULL)
+            unix_error("fdopen failed in read_trace");
+        read_trace_bin(trace, tracefile, path);
+        fclose(tracefile);
+        return trace;
+    }
+
+    if (st.st_size == 0 ||
+        (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) 
+        == MAP_FAILED) {
+        printf("Could not map %s in read_trace: %s\n", path,
+               st.st_size ? strerror(errno) : "empty file");
+        exit(1);
+    }
+    close(fd);
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    read_trace_text(trace, (const char *)map, st.st_size, path);
+    munmap(map, st.st_size);
+    return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    free(trace->ops);         /* free the three arrays... */
+    free(trace->blocks);      
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * write_trace - Write a trace as a .rep or binary trace file
+ */
+void write_trace(trace_t *trace, char *path)
+{
+    size_t len = strlen(path);
+    int binary = (len > 4 && !strcmp(path + len - 4, ".bin"));
+    static char types[] = {'a', 'f', 'r'};   /* by ALLOC, FREE, REALLOC */
+    trace_bin_header_t hdr;
+    trace_bin_op_t op;
+    traceop_t *o;
+    FILE *fp;
+    int i, ok = 1;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        printf("Could not open %s in write_trace: %s\n", path, 
+               strerror(errno));
+        exit(1);
+    }
+    if (binary) {
+        hdr.magic = TRACE_BIN_MAGIC;
+        hdr.record_size = sizeof(trace_bin_op_t);
+        hdr.sugg_heapsize = trace->sugg_heapsize;
+        hdr.num_ids = trace->num_ids;
+        hdr.num_ops = trace->num_ops;
+        hdr.weight = trace->weight;
+        ok &= fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+        memset(&op, 0, sizeof(op));
+        for (i = 0; i < trace->num_ops && ok; i++) {
+            op.type = types[trace->ops[i].type];
+            op.index = trace->ops[i].index;
+            op.size = trace->ops[i].type == FREE ? 0 : trace->ops[i].size;
+            ok &= fwrite(&op, sizeof(op), 1, fp) == 1;
+        }
+    }
+    else {
+        ok &= fprintf(fp, "%d\n%d\n%d\n%d\n", trace->sugg_heapsize,
+                      trace->num_ids, trace->num_ops, trace->weight) > 0;
+        for (i = 0; i < trace->num_ops && ok; i++) {
+            o = &trace->ops[i];
+            if (o->type == FREE)
+                ok &= fprintf(fp, "f %d\n", o->index) > 0;
+            else
+                ok &= fprintf(fp, "%c %d %d\n", types[o->type], o->index,
+                              o->size) > 0;
+        }
+    }
+    if (fclose(fp) != 0 || !ok) {
+        printf("Could not write %s in write_trace: %s\n", path,
+               strerror(errno));
+        exit(1);
+    }
+}
+
+/*
+ * mix_traces - Interleave the requests of several traces (see trace.h)
+ */
+trace_t *mix_traces(trace_t **traces, int n, int mix, double *weights,
+                    unsigned seed, int **tenant)
+{
+    trace_t *trace;
+    int *next;          /* next request of each trace */
+    int *base;          /* first block id of each trace */
+    double *w, *credit, total;
+    int i, t, pick;
+
+    if ((trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL ||
+        (next = (int *)calloc(n, sizeof(int))) == NULL ||
+        (base = (int *)calloc(n, sizeof(int))) == NULL ||
+        (w = (double *)calloc(n, sizeof(double))) == NULL ||
+        (credit = (double *)calloc(n, sizeof(double))) == NULL)
+        unix_error("malloc failed in mix_traces");
+
+    for (t = 0; t < n; t++) {
+        base[t] = trace->num_ids;
+        if (traces[t]->num_ids > INT_MAX - trace->num_ids ||
+            traces[t]->num_ops > INT_MAX - trace->num_ops) {
+            printf("Too many requests to mix in mix_traces\n");
+            exit(1);
+        }
+        trace->num_ids += traces[t]->num_ids;
+        trace->num_ops += traces[t]->num_ops;
+        trace->sugg_heapsize += traces[t]->sugg_heapsize;
+        w[t] = weights ? weights[t] : traces[t]->num_ops;
+        if (w[t] <= 0) {
+            printf("Trace %d has no weight in mix_traces\n", t);
+            exit(1);
+        }
+    }
+    trace->weight = 1;
+    if ((trace->ops = (traceop_t *)
+         malloc(trace->num_ops * sizeof(traceop_t))) == NULL ||
+        (trace->blocks = (char **)
+         malloc(trace->num_ids * sizeof(char *))) == NULL ||
+        (trace->block_sizes = (size_t *)
+         malloc(trace->num_ids * sizeof(size_t))) == NULL ||
+        (tenant && (*tenant = (int *)
+                    malloc(trace->num_ops * sizeof(int))) == NULL))
+        unix_error("malloc failed in mix_traces");
+
+    /* Under MIX_ARRIVAL, credit is each trace's next arrival time */
+    if (mix == MIX_ARRIVAL)
+        for (t = 0; t < n; t++)
+            credit[t] = -log((rand_r(&seed) + 1.0) / (RAND_MAX + 2.0)) / w[t];
+
+    pick = n - 1;
+    for (i = 0; i < trace->num_ops; i++) {
+        switch (mix) {
+        case MIX_RR:
+            do
+                pick = (pick + 1) % n;
+            while (next[pick] == traces[pick]->num_ops);
+            break;
+        case MIX_WEIGHTED:
+            total = 0;
+            pick = -1;
+            for (t = 0; t < n; t++) {
+                if (next[t] == traces[t]->num_ops)
+                    continue;
+                credit[t] += w[t];
+                total += w[t];
+                if (pick < 0 || credit[t] > credit[pick])
+                    pick = t;
+            }
+            credit[pick] -= total;
+            break;
+        case MIX_ARRIVAL:
+            pick = -1;
+            for (t = 0; t < n; t++)
+                if (next[t] < traces[t]->num_ops &&
+                    (pick < 0 || credit[t] < credit[pick]))
+                    pick = t;
+            credit[pick] += 
+                -log((rand_r(&seed) + 1.0) / (RAND_MAX + 2.0)) / w[pick];
+            break;
+        default:
+            printf("Unknown mix %d in mix_traces\n", mix);
+            exit(1);
+        }
+        trace->ops[i] = traces[pick]->ops[next[pick]++];
+        trace->ops[i].index += base[pick];
+        if (tenant)
+            (*tenant)[i] = pick;
+    }
+
+    free(next);
+    free(base);
+    free(w);
+    free(credit);
+    return trace;
+}
+
+/*
+ * unix_error - Report a Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
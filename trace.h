@@ -0,0 +1,59 @@
+/*
+ * trace.h - Reading malloc trace files into memory
+ *
+ * A trace is either a .rep text file (a header of four numbers: the
+ * suggested heap size, the number of block ids, the number of requests
+ * and the weight; then one "a id size", "r id size" or "f id" line per
+ * request) or the binary equivalent described in tracefmt.h.
+ */
+#include <stddef.h>
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (mm_init_hint with -H) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight of this trace in the performance index */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    int peak_op;         /* op at which live bytes first peak (eval_mm_util) */
+} trace_t;
+
+/* Read a trace file, exiting with a message if it can't be read */
+trace_t *read_trace(char *tracedir, char *filename, int verbose);
+
+/* Free a trace returned by read_trace */
+void free_trace(trace_t *trace);
+
+/*
+ * Write a trace to path, in the binary format if path ends in ".bin"
+ * and as a .rep text file otherwise, exiting with a message on error
+ */
+void write_trace(trace_t *trace, char *path);
+
+/* How mix_traces interleaves the requests of its traces */
+enum {
+    MIX_RR,        /* one request from each trace in turn */
+    MIX_WEIGHTED,  /* smooth weighted round-robin */
+    MIX_ARRIVAL    /* random arrivals, each trace at its own mean rate */
+};
+
+/*
+ * Interleave the requests of n traces into one trace, the first using
+ * block ids from 0, the next from the first's num_ids, and so on. Each
+ * trace keeps the order of its own requests. The weights (NULL: each
+ * trace's num_ops, so all end together) set each trace's share of the
+ * requests under MIX_WEIGHTED and its rate under MIX_ARRIVAL, which
+ * draws the same arrivals for the same seed. If tenant is not NULL, it
+ * gets a new array with the trace each request came from.
+ */
+trace_t *mix_traces(trace_t **traces, int n, int mix, double *weights,
+                    unsigned seed, int **tenant);
@@ -0,0 +1,26 @@
+/*
+ * Binary trace format, a compact alternative to the .rep text format
+ * written by mmcapture.so and read by mdriver.
+ *
+ * A file is this header followed by num_ops records. The fields mean
+ * the same as the .rep header lines and request lines.
+ */
+#include <stdint.h>
+
+#define TRACE_BIN_MAGIC 0x52544d4dU   /* "MMTR" in little-endian order */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t record_size;     /* sizeof(trace_bin_op_t) */
+    uint32_t sugg_heapsize;
+    uint32_t num_ids;
+    uint32_t num_ops;
+    uint32_t weight;
+} trace_bin_header_t;
+
+typedef struct {
+    uint8_t type;             /* 'a', 'f' or 'r', as in .rep files */
+    uint8_t pad[3];
+    uint32_t index;           /* block id */
+    uint32_t size;            /* request size (0 for 'f') */
+} trace_bin_op_t;